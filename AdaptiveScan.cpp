@@ -0,0 +1,158 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "AdaptiveScan.h"
+
+#include <algorithm>
+
+using namespace opendnp3;
+using namespace std::chrono;
+
+AdaptiveScan::AdaptiveScan(const AdaptivePollConfig& config,
+                           std::function<uint64_t()> eventCounter,
+                           std::shared_ptr<Histogram> durations)
+    : config(config),
+      eventCounter(std::move(eventCounter)),
+      durations(std::move(durations)),
+      interval(config.initialInterval),
+      due(steady_clock::now() + config.initialInterval)
+{
+}
+
+void AdaptiveScan::Attach(std::shared_ptr<IMasterScan> scan)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->scan = std::move(scan);
+}
+
+void AdaptiveScan::Tick(steady_clock::time_point now)
+{
+    std::shared_ptr<IMasterScan> demand;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!scan || running || now < due)
+        {
+            return;
+        }
+
+        // not due again until this poll completes
+        due = steady_clock::time_point::max();
+        demand = scan;
+    }
+
+    demand->Demand();
+}
+
+void AdaptiveScan::OnStart()
+{
+    const auto events = eventCounter();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    running = true;
+    started = steady_clock::now();
+    eventsAtStart = events;
+}
+
+void AdaptiveScan::OnComplete(TaskCompletion result)
+{
+    const auto events = eventCounter();
+    const auto now = steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    running = false;
+    lastLatency = duration_cast<milliseconds>(now - started);
+    if (durations)
+    {
+        durations->Record(lastLatency.count());
+    }
+
+    const auto fast = lastLatency <= config.latencyLimit;
+    const auto busy = events != eventsAtStart;
+
+    if (result == TaskCompletion::SUCCESS && fast && busy)
+    {
+        Scale(config.speedup);
+    }
+    else
+    {
+        // idle link, slow or failing outstation
+        Scale(config.backoff);
+    }
+
+    due = now + interval;
+}
+
+void AdaptiveScan::Scale(double factor)
+{
+    const auto next = milliseconds(static_cast<milliseconds::rep>(interval.count() * factor));
+    interval = std::min(config.maxInterval, std::max(config.minInterval, next));
+}
+
+milliseconds AdaptiveScan::Interval() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return interval;
+}
+
+milliseconds AdaptiveScan::LastLatency() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastLatency;
+}
+
+PollScheduler::PollScheduler(milliseconds resolution) : resolution(resolution) {}
+
+PollScheduler::~PollScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    signal.notify_one();
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void PollScheduler::Add(std::shared_ptr<AdaptiveScan> scan)
+{
+    scans.push_back(std::move(scan));
+}
+
+void PollScheduler::Start()
+{
+    worker = std::thread([this]() { Run(); });
+}
+
+void PollScheduler::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!signal.wait_for(lock, resolution, [this]() { return stopping; }))
+    {
+        const auto now = steady_clock::now();
+        for (auto& scan : scans)
+        {
+            scan->Tick(now);
+        }
+    }
+}
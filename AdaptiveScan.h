@@ -0,0 +1,136 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_ADAPTIVESCAN_H
+#define MASTER_ADAPTIVESCAN_H
+
+#include "Histogram.h"
+
+#include <opendnp3/master/IMasterScan.h>
+#include <opendnp3/master/ITaskCallback.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct AdaptivePollConfig
+{
+    /// fastest the scan is demanded, while every poll returns events
+    std::chrono::milliseconds minInterval{500};
+
+    /// slowest the scan runs, on an idle link. Also the period the scan is registered with.
+    std::chrono::milliseconds maxInterval{30000};
+
+    /// interval used until the first poll completes
+    std::chrono::milliseconds initialInterval{2000};
+
+    /// polls slower than this back off even when they return events
+    std::chrono::milliseconds latencyLimit{1000};
+
+    /// interval multiplier after a poll that returned events
+    double speedup = 0.5;
+
+    /// interval multiplier after an idle, slow or failed poll
+    double backoff = 1.5;
+};
+
+/**
+ * Adjusts how often one master's exception scan runs from the outcome of each poll.
+ *
+ * Attached to the scan as its task callback, it measures each poll from start to completion
+ * and counts the events that came back. The scan is registered at maxInterval and
+ * PollScheduler calls Demand() on it whenever the adaptive interval has elapsed.
+ */
+class AdaptiveScan final : public opendnp3::ITaskCallback
+{
+public:
+    /**
+     * @param config interval bounds and step sizes
+     * @param eventCounter returns the running count of points received by the scan's SOE handler
+     * @param durations optionally receives the duration of every poll in milliseconds
+     */
+    AdaptiveScan(const AdaptivePollConfig& config,
+                 std::function<uint64_t()> eventCounter,
+                 std::shared_ptr<Histogram> durations = nullptr);
+
+    /// Must be called once, with the scan this object was registered as the callback of
+    void Attach(std::shared_ptr<opendnp3::IMasterScan> scan);
+
+    /// Demand the scan if it is idle and its interval has elapsed
+    void Tick(std::chrono::steady_clock::time_point now);
+
+    void OnStart() override;
+    void OnComplete(opendnp3::TaskCompletion result) override;
+    void OnDestroyed() override {}
+
+    std::chrono::milliseconds Interval() const;
+    std::chrono::milliseconds LastLatency() const;
+
+private:
+    void Scale(double factor);
+
+    const AdaptivePollConfig config;
+    const std::function<uint64_t()> eventCounter;
+    const std::shared_ptr<Histogram> durations;
+
+    mutable std::mutex mutex;
+    std::shared_ptr<opendnp3::IMasterScan> scan;
+    std::chrono::milliseconds interval;
+    std::chrono::milliseconds lastLatency{0};
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point due;
+    uint64_t eventsAtStart = 0;
+    bool running = false;
+};
+
+/**
+ * Drives a set of AdaptiveScans from one background thread.
+ */
+class PollScheduler
+{
+public:
+    explicit PollScheduler(std::chrono::milliseconds resolution = std::chrono::milliseconds(50));
+    ~PollScheduler();
+
+    PollScheduler(const PollScheduler&) = delete;
+    PollScheduler& operator=(const PollScheduler&) = delete;
+
+    /// Add every scan before calling Start
+    void Add(std::shared_ptr<AdaptiveScan> scan);
+
+    void Start();
+
+private:
+    void Run();
+
+    const std::chrono::milliseconds resolution;
+    std::vector<std::shared_ptr<AdaptiveScan>> scans;
+
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_CHANGEFILTER_H
+#define MASTER_CHANGEFILTER_H
+
+#include "RegisterMap.h"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Report-by-exception in front of the reading sink.
+ *
+ * Keeps the last emitted value, flags and time of every point in flat arrays laid out like the
+ * register map's tables. A reading of a filtered point is suppressed while it stays inside the
+ * point's deadband with unchanged flags, unless its maxInterval has passed since the last emit.
+ * Points without filter settings always pass. Accept is driven from a single thread.
+ */
+class ChangeFilter
+{
+public:
+    explicit ChangeFilter(const RegisterMap& map)
+    {
+        Reset(map);
+    }
+
+    /// Forget every point's reference and lay the arrays out for a new map. The count is kept.
+    void Reset(const RegisterMap& map)
+    {
+        for (size_t i = 0; i < POINT_TYPE_COUNT; ++i)
+        {
+            states[i].assign(map.TableSize(static_cast<PointType>(i)), PointState());
+        }
+    }
+
+    /**
+     * @param now monotonic time in milliseconds
+     * @return true if the reading should be emitted, in which case it becomes the new reference
+     */
+    bool Accept(const PointConfig& point, PointType type, uint16_t index, double value, uint8_t flags, uint64_t now)
+    {
+        if (!point.filtered)
+        {
+            return true;
+        }
+
+        auto& state = states[static_cast<size_t>(type)][index];
+
+        if (state.emitted && flags == state.flags && !Expired(point, state, now))
+        {
+            const auto band = point.deadbandPercent ? std::fabs(state.value) * point.deadband / 100.0 : point.deadband;
+            if (std::fabs(value - state.value) <= band)
+            {
+                // single writer, the atomic only makes the count safe to read from other threads
+                suppressed.store(suppressed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        state.emitted = true;
+        state.flags = flags;
+        state.value = value;
+        state.time = now;
+        return true;
+    }
+
+    /// @return number of readings suppressed so far
+    uint64_t Suppressed() const
+    {
+        return suppressed.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct PointState
+    {
+        double value = 0.0;
+        uint64_t time = 0;
+        uint8_t flags = 0;
+        bool emitted = false;
+    };
+
+    static bool Expired(const PointConfig& point, const PointState& state, uint64_t now)
+    {
+        return point.maxIntervalMs != 0 && now - state.time >= point.maxIntervalMs;
+    }
+
+    std::array<std::vector<PointState>, POINT_TYPE_COUNT> states;
+    std::atomic<uint64_t> suppressed{0};
+};
+
+#endif
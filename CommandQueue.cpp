@@ -0,0 +1,285 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CommandQueue.h"
+
+#include <opendnp3/master/CommandPointResult.h>
+#include <opendnp3/master/ICommandTaskResult.h>
+
+#include <algorithm>
+
+using namespace opendnp3;
+
+namespace
+{
+
+/// Report every command of a queue as never sent
+template<class Queue> void Cancel(Queue& queue, std::chrono::steady_clock::time_point now)
+{
+    for (auto& queued : queue)
+    {
+        CommandResult result;
+        result.index = queued.index;
+        result.latency = std::chrono::duration_cast<std::chrono::microseconds>(now - queued.submitted);
+        queued.callback(result);
+    }
+    queue.clear();
+}
+
+/// Lower oldest to the submit time of the first command in a queue
+template<class Queue> void Front(const Queue& queue, std::chrono::steady_clock::time_point& oldest)
+{
+    if (!queue.empty())
+    {
+        oldest = std::min(oldest, queue.front().submitted);
+    }
+}
+
+} // namespace
+
+CommandQueue::CommandQueue(std::shared_ptr<IMaster> master,
+                           const CommandQueueConfig& config,
+                           ServiceThread& sender,
+                           std::shared_ptr<Histogram> latencies)
+    : master(std::move(master)),
+      config(config),
+      latencies(std::move(latencies)),
+      inFlight(std::make_shared<InFlight>()),
+      sender(sender)
+{
+    inFlight->sender = &sender;
+    sender.Add(this);
+}
+
+CommandQueue::~CommandQueue()
+{
+    sender.Remove(this);
+    {
+        // requests still outstanding complete without waking anything
+        std::lock_guard<std::mutex> lock(inFlight->mutex);
+        inFlight->sender = nullptr;
+    }
+
+    const auto now = Clock::now();
+    Cancel(std::get<0>(queued), now);
+    Cancel(std::get<1>(queued), now);
+    Cancel(std::get<2>(queued), now);
+    Cancel(std::get<3>(queued), now);
+    Cancel(std::get<4>(queued), now);
+}
+
+void CommandQueue::Submit(const ControlRelayOutputBlock& command, uint16_t index, CommandCallback callback)
+{
+    Enqueue(command, index, std::move(callback));
+}
+
+void CommandQueue::Submit(const AnalogOutputInt16& command, uint16_t index, CommandCallback callback)
+{
+    Enqueue(command, index, std::move(callback));
+}
+
+void CommandQueue::Submit(const AnalogOutputInt32& command, uint16_t index, CommandCallback callback)
+{
+    Enqueue(command, index, std::move(callback));
+}
+
+void CommandQueue::Submit(const AnalogOutputFloat32& command, uint16_t index, CommandCallback callback)
+{
+    Enqueue(command, index, std::move(callback));
+}
+
+void CommandQueue::Submit(const AnalogOutputDouble64& command, uint16_t index, CommandCallback callback)
+{
+    Enqueue(command, index, std::move(callback));
+}
+
+uint64_t CommandQueue::Submitted() const
+{
+    std::lock_guard<std::mutex> lock(inFlight->mutex);
+    return submitted;
+}
+
+uint64_t CommandQueue::Requests() const
+{
+    std::lock_guard<std::mutex> lock(inFlight->mutex);
+    return requests;
+}
+
+size_t CommandQueue::Pending() const
+{
+    std::lock_guard<std::mutex> lock(inFlight->mutex);
+    return pending;
+}
+
+template<class T> void CommandQueue::Enqueue(const T& command, uint16_t index, CommandCallback callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(inFlight->mutex);
+        std::get<std::deque<Queued<T>>>(queued).push_back(Queued<T>{command, index, std::move(callback), Clock::now()});
+        ++pending;
+        ++submitted;
+    }
+    sender.Wake();
+}
+
+template<class T>
+void CommandQueue::Take(CommandSet& commands, std::vector<Sent>& sent, uint16_t& headers, size_t limit)
+{
+    auto& queue = std::get<std::deque<Queued<T>>>(queued);
+    if (queue.empty() || limit == 0)
+    {
+        return;
+    }
+
+    const auto first = sent.size();
+    auto& header = commands.StartHeader<T>();
+    while (!queue.empty() && sent.size() - first < limit)
+    {
+        auto& next = queue.front();
+
+        // a second command to the same point keeps its order by waiting for the next request
+        const auto begin = sent.begin() + first;
+        if (std::any_of(begin, sent.end(), [&next](const Sent& other) { return other.index == next.index; }))
+        {
+            break;
+        }
+
+        header.Add(next.command, next.index);
+        sent.push_back(Sent{headers, next.index, std::move(next.callback), next.submitted});
+        queue.pop_front();
+    }
+    ++headers;
+}
+
+CommandQueue::Clock::time_point CommandQueue::Oldest() const
+{
+    auto oldest = Clock::time_point::max();
+    Front(std::get<0>(queued), oldest);
+    Front(std::get<1>(queued), oldest);
+    Front(std::get<2>(queued), oldest);
+    Front(std::get<3>(queued), oldest);
+    Front(std::get<4>(queued), oldest);
+    return oldest;
+}
+
+CommandQueue::Clock::time_point CommandQueue::Service(Clock::time_point now)
+{
+    const auto maxBatch = std::max<size_t>(config.maxBatch, 1);
+    const auto maxInFlight = std::max<size_t>(config.maxInFlight, 1);
+
+    // a new command or a completed request wakes the thread again
+    std::unique_lock<std::mutex> lock(inFlight->mutex);
+    while (pending > 0 && inFlight->requests < maxInFlight)
+    {
+        // give later commands the rest of the window to join, unless the batch is already full
+        const auto due = Oldest() + config.window;
+        if (pending < maxBatch && now < due)
+        {
+            return due;
+        }
+
+        CommandSet commands;
+        std::vector<Sent> sent;
+        uint16_t headers = 0;
+        Take<ControlRelayOutputBlock>(commands, sent, headers, maxBatch - sent.size());
+        Take<AnalogOutputInt16>(commands, sent, headers, maxBatch - sent.size());
+        Take<AnalogOutputInt32>(commands, sent, headers, maxBatch - sent.size());
+        Take<AnalogOutputFloat32>(commands, sent, headers, maxBatch - sent.size());
+        Take<AnalogOutputDouble64>(commands, sent, headers, maxBatch - sent.size());
+
+        pending -= sent.size();
+        ++inFlight->requests;
+        ++requests;
+
+        lock.unlock();
+        Send(std::move(commands), std::move(sent));
+        lock.lock();
+    }
+
+    return Clock::time_point::max();
+}
+
+void CommandQueue::Send(CommandSet commands, std::vector<Sent> sent)
+{
+    auto batch = std::make_shared<std::vector<Sent>>(std::move(sent));
+    auto shared = inFlight;
+    auto histogram = latencies;
+
+    auto complete = [batch, shared, histogram](const ICommandTaskResult& response) {
+        // free the slot first, so the next batch goes out while the callbacks run
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            --shared->requests;
+            if (shared->sender)
+            {
+                shared->sender->Wake();
+            }
+        }
+
+        const auto now = Clock::now();
+        std::vector<bool> reported(batch->size(), false);
+
+        auto report = [&](size_t i, CommandPointState state, CommandStatus status) {
+            const auto& command = (*batch)[i];
+            CommandResult result;
+            result.index = command.index;
+            result.summary = response.summary;
+            result.state = state;
+            result.status = status;
+            result.batchSize = batch->size();
+            result.latency = std::chrono::duration_cast<std::chrono::microseconds>(now - command.submitted);
+            if (histogram)
+            {
+                histogram->Record(std::chrono::duration_cast<std::chrono::milliseconds>(result.latency).count());
+            }
+            reported[i] = true;
+            command.callback(result);
+        };
+
+        response.ForeachItem([&](const CommandPointResult& point) {
+            for (size_t i = 0; i < batch->size(); ++i)
+            {
+                const auto& command = (*batch)[i];
+                if (!reported[i] && command.header == point.headerIndex && command.index == point.index)
+                {
+                    report(i, point.state, point.status);
+                    break;
+                }
+            }
+        });
+
+        // a request that failed as a whole may not list every point
+        for (size_t i = 0; i < batch->size(); ++i)
+        {
+            if (!reported[i])
+            {
+                report(i, CommandPointState::INIT, CommandStatus::UNDEFINED);
+            }
+        }
+    };
+
+    if (config.selectBeforeOperate)
+    {
+        master->SelectAndOperate(std::move(commands), complete);
+    }
+    else
+    {
+        master->DirectOperate(std::move(commands), complete);
+    }
+}
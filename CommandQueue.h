@@ -0,0 +1,184 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_COMMANDQUEUE_H
+#define MASTER_COMMANDQUEUE_H
+
+#include "Histogram.h"
+#include "ServicePool.h"
+
+#include <opendnp3/app/AnalogOutput.h>
+#include <opendnp3/app/ControlRelayOutputBlock.h>
+#include <opendnp3/gen/CommandPointState.h>
+#include <opendnp3/gen/CommandStatus.h>
+#include <opendnp3/gen/TaskCompletion.h>
+#include <opendnp3/master/CommandSet.h>
+#include <opendnp3/master/IMaster.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+struct CommandQueueConfig
+{
+    /// how long the oldest queued command waits for others to share its request
+    std::chrono::milliseconds window{20};
+
+    /// most commands in one request, a full batch is sent without waiting for the window
+    size_t maxBatch = 32;
+
+    /// requests outstanding at once, further batches wait for a result
+    size_t maxInFlight = 1;
+
+    /// select before operate, otherwise direct operate
+    bool selectBeforeOperate = true;
+};
+
+/**
+ * Outcome of one queued command
+ */
+struct CommandResult
+{
+    uint16_t index = 0;
+    opendnp3::TaskCompletion summary = opendnp3::TaskCompletion::FAILURE_NO_COMMS;
+    opendnp3::CommandPointState state = opendnp3::CommandPointState::INIT;
+    opendnp3::CommandStatus status = opendnp3::CommandStatus::UNDEFINED;
+    size_t batchSize = 0;                  // commands in the request this one was sent in
+    std::chrono::microseconds latency{0};  // from Submit to the result
+
+    bool Success() const
+    {
+        return summary == opendnp3::TaskCompletion::SUCCESS && state == opendnp3::CommandPointState::SUCCESS
+            && status == opendnp3::CommandStatus::SUCCESS;
+    }
+};
+
+using CommandCallback = std::function<void(const CommandResult&)>;
+
+/**
+ * Queues control relay and analog output commands for one master and sends them in batches.
+ *
+ * Commands submitted within the window are coalesced into one multi-header CommandSet, one
+ * header per command type, and go out as a single select/operate exchange instead of one per
+ * command. A point is commanded at most once per request, a second command to the same point
+ * waits for the next one. Each command's callback runs on the stack thread once the request
+ * completes.
+ *
+ * Batches are sent from a ServiceThread shared with other queues. Submit may be called from
+ * any thread.
+ */
+class CommandQueue final : private IService
+{
+public:
+    /**
+     * @param master the master the commands are sent through
+     * @param config coalescing window and limits
+     * @param sender the thread batches are sent from
+     * @param latencies optionally receives every command's latency in milliseconds, written
+     *                  from the master's stack thread
+     */
+    CommandQueue(std::shared_ptr<opendnp3::IMaster> master,
+                 const CommandQueueConfig& config,
+                 ServiceThread& sender,
+                 std::shared_ptr<Histogram> latencies = nullptr);
+
+    /// Stops sending. Commands still queued are reported as not sent.
+    ~CommandQueue();
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    void Submit(const opendnp3::ControlRelayOutputBlock& command, uint16_t index, CommandCallback callback);
+    void Submit(const opendnp3::AnalogOutputInt16& command, uint16_t index, CommandCallback callback);
+    void Submit(const opendnp3::AnalogOutputInt32& command, uint16_t index, CommandCallback callback);
+    void Submit(const opendnp3::AnalogOutputFloat32& command, uint16_t index, CommandCallback callback);
+    void Submit(const opendnp3::AnalogOutputDouble64& command, uint16_t index, CommandCallback callback);
+
+    /// @return commands accepted by Submit
+    uint64_t Submitted() const;
+
+    /// @return requests sent to the outstation
+    uint64_t Requests() const;
+
+    /// @return commands waiting to be sent
+    size_t Pending() const;
+
+private:
+    template<class T> struct Queued
+    {
+        T command;
+        uint16_t index;
+        CommandCallback callback;
+        Clock::time_point submitted;
+    };
+
+    /// A command that has been sent, matched to its result by header and point index
+    struct Sent
+    {
+        uint16_t header;
+        uint16_t index;
+        CommandCallback callback;
+        Clock::time_point submitted;
+    };
+
+    /// What the completion callback shares with the queue, which it may outlive
+    struct InFlight
+    {
+        std::mutex mutex;
+        ServiceThread* sender = nullptr; // woken when a request completes, null once the queue is gone
+        size_t requests = 0;
+    };
+
+    template<class T> void Enqueue(const T& command, uint16_t index, CommandCallback callback);
+
+    /// Move up to limit commands of one type into a header of the set. Lock held.
+    template<class T>
+    void Take(opendnp3::CommandSet& commands, std::vector<Sent>& sent, uint16_t& headers, size_t limit);
+
+    Clock::time_point Service(Clock::time_point now) override;
+    void Send(opendnp3::CommandSet commands, std::vector<Sent> sent);
+
+    /// Lock held
+    Clock::time_point Oldest() const;
+
+    const std::shared_ptr<opendnp3::IMaster> master;
+    const CommandQueueConfig config;
+    const std::shared_ptr<Histogram> latencies;
+    const std::shared_ptr<InFlight> inFlight;
+
+    ServiceThread& sender;
+
+    // guarded by inFlight->mutex
+    std::tuple<std::deque<Queued<opendnp3::ControlRelayOutputBlock>>,
+               std::deque<Queued<opendnp3::AnalogOutputInt16>>,
+               std::deque<Queued<opendnp3::AnalogOutputInt32>>,
+               std::deque<Queued<opendnp3::AnalogOutputFloat32>>,
+               std::deque<Queued<opendnp3::AnalogOutputDouble64>>>
+        queued;
+    size_t pending = 0;
+    uint64_t submitted = 0;
+    uint64_t requests = 0;
+};
+
+#endif
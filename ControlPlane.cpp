@@ -0,0 +1,456 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ControlPlane.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// a line longer than this, or replies a client does not read, close the connection
+static const size_t MAX_BUFFERED = 1024 * 1024;
+
+// largest repeat count accepted in front of a command
+static const unsigned long MAX_REPEAT = 1000000;
+
+// written by the signal handler, read end polled by Run
+static int signalWrite = -1;
+
+static void OnSignal(int)
+{
+    const char byte = 0;
+    if (write(signalWrite, &byte, 1) < 0)
+    {
+        // the pipe is full, a wakeup is already pending
+    }
+}
+
+ControlPlane::ControlPlane() : epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (pipe2(signals, O_NONBLOCK | O_CLOEXEC) == 0)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = signals[0];
+        epoll_ctl(epoll, EPOLL_CTL_ADD, signals[0], &event);
+
+        signalWrite = signals[1];
+        struct sigaction action{};
+        action.sa_handler = OnSignal;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+
+    Add("help|?", "list the commands", [this](const std::vector<std::string>&, std::ostream& output) {
+        PrintHelp(output);
+        return true;
+    });
+}
+
+ControlPlane::~ControlPlane()
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signalWrite = -1;
+
+    for (const auto& connection : connections)
+    {
+        if (connection.first != input)
+        {
+            close(connection.first);
+        }
+    }
+
+    if (listener >= 0)
+    {
+        close(listener);
+        unlink(socketPath.c_str());
+    }
+
+    for (const auto fd : signals)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    if (epoll >= 0)
+    {
+        close(epoll);
+    }
+}
+
+void ControlPlane::Add(const std::string& names, const std::string& help, Handler handler)
+{
+    commands.emplace_back(names, Command{help, std::move(handler), false});
+
+    std::istringstream aliases(names);
+    std::string name;
+    while (std::getline(aliases, name, '|'))
+    {
+        byName[name] = commands.size() - 1;
+    }
+}
+
+void ControlPlane::AddRaw(const std::string& names, const std::string& help, Handler handler)
+{
+    Add(names, help, std::move(handler));
+    commands.back().second.raw = true;
+}
+
+void ControlPlane::WatchInput(int fd)
+{
+    input = fd;
+    connections[fd] = Connection();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0 && errno == EPERM)
+    {
+        inputIsFile = true;
+    }
+}
+
+bool ControlPlane::Listen(const std::string& path, std::string& errors)
+{
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        errors += "control socket path is too long: " + path + "\n";
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // a socket left behind by an earlier run, never any other kind of file
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(path.c_str());
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, 16) != 0)
+    {
+        errors += "cannot listen on " + path + ": " + strerror(errno) + "\n";
+        if (listener >= 0)
+        {
+            close(listener);
+            listener = -1;
+        }
+        return false;
+    }
+    socketPath = path;
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+    return true;
+}
+
+void ControlPlane::Run()
+{
+    epoll_event events[16];
+
+    while (!stopping)
+    {
+        if (inputIsFile)
+        {
+            Read(input);
+        }
+
+        const auto count = epoll_wait(epoll, events, 16, inputIsFile ? 0 : -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "control plane: epoll_wait failed: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count && !stopping; ++i)
+        {
+            const auto fd = events[i].data.fd;
+            if (fd == signals[0])
+            {
+                std::cout << "Signal received, exiting" << std::endl;
+                stopping = true;
+            }
+            else if (fd == listener)
+            {
+                Accept();
+            }
+            else
+            {
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    Read(fd);
+                }
+                if ((events[i].events & EPOLLOUT) && connections.count(fd))
+                {
+                    Write(fd);
+                }
+            }
+        }
+    }
+}
+
+void ControlPlane::Stop()
+{
+    stopping = true;
+}
+
+void ControlPlane::PrintHelp(std::ostream& output) const
+{
+    output << "Enter one or more commands separated by ';', prefix a command with N* to repeat it" << std::endl;
+    for (const auto& command : commands)
+    {
+        output << command.first << " - " << command.second.help << std::endl;
+    }
+}
+
+void ControlPlane::Accept()
+{
+    while (true)
+    {
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        connections[fd].framed = true;
+    }
+}
+
+void ControlPlane::Read(int fd)
+{
+    char buffer[4096];
+    const auto count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return;
+    }
+    if (count <= 0)
+    {
+        // end of input, keep running on the socket and signals alone
+        if (fd == input)
+        {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+            connections.erase(fd);
+            inputIsFile = false;
+            input = -1;
+        }
+        else
+        {
+            Close(fd);
+        }
+        return;
+    }
+
+    auto& connection = connections[fd];
+    connection.input.append(buffer, count);
+
+    size_t start = 0;
+    size_t end;
+    while (!stopping && (end = connection.input.find('\n', start)) != std::string::npos)
+    {
+        auto line = connection.input.substr(start, end - start);
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        std::ostringstream output;
+        const bool executed = Execute(line, output);
+        if (fd == input)
+        {
+            std::cout << output.str() << std::flush;
+        }
+        else
+        {
+            connection.output += output.str();
+            if (connection.framed && executed)
+            {
+                connection.output += "ok\n";
+            }
+        }
+    }
+    connection.input.erase(0, start);
+
+    if (fd == input)
+    {
+        return;
+    }
+    if (connection.input.size() > MAX_BUFFERED)
+    {
+        connection.output += "error: line too long\n";
+        connection.closing = true;
+    }
+    Write(fd);
+}
+
+void ControlPlane::Write(int fd)
+{
+    auto& connection = connections[fd];
+    while (!connection.output.empty())
+    {
+        const auto sent = send(fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            Close(fd);
+            return;
+        }
+        connection.output.erase(0, sent);
+    }
+
+    if (connection.output.size() > MAX_BUFFERED || (connection.closing && connection.output.empty()))
+    {
+        Close(fd);
+        return;
+    }
+    Update(fd);
+}
+
+void ControlPlane::Close(int fd)
+{
+    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+void ControlPlane::Update(int fd)
+{
+    // only ask for writability while replies are waiting, or epoll reports it on every wait
+    epoll_event event{};
+    event.events = EPOLLIN;
+    if (!connections[fd].output.empty())
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+}
+
+bool ControlPlane::Execute(const std::string& line, std::ostream& output)
+{
+    for (size_t start = 0; start < line.size();)
+    {
+        auto end = line.find(';', start);
+        if (end == std::string::npos)
+        {
+            end = line.size();
+        }
+
+        std::istringstream words(line.substr(start, end - start));
+        std::vector<std::string> args;
+        std::string name;
+        if (!(words >> name))
+        {
+            start = end + 1;
+            continue;
+        }
+        const auto afterName = std::min(line.find_first_of(" \t\r", line.find_first_not_of(" \t\r", start)), end);
+
+        unsigned long repeat = 1;
+        const auto star = name.find('*');
+        if (star != std::string::npos)
+        {
+            char* end = nullptr;
+            repeat = strtoul(name.c_str(), &end, 10);
+            if (end != name.c_str() + star || repeat == 0 || repeat > MAX_REPEAT)
+            {
+                output << "error: bad repeat count in '" << name << "'" << std::endl;
+                return false;
+            }
+            name.erase(0, star + 1);
+        }
+
+        const auto found = byName.find(name);
+        if (found == byName.end())
+        {
+            output << "error: unknown command '" << name << "', try help" << std::endl;
+            return false;
+        }
+
+        const auto& command = commands[found->second].second;
+        if (command.raw)
+        {
+            // inline JSON runs to the end of the line whatever ';' it holds, anything else ends at the next ';'
+            const auto first = line.find_first_not_of(" \t\r", afterName);
+            if (first < end)
+            {
+                if (line[first] == '{' || line[first] == '[')
+                {
+                    end = line.size();
+                }
+                args.push_back(line.substr(first, line.find_last_not_of(" \t\r", end - 1) + 1 - first));
+            }
+        }
+        else
+        {
+            for (std::string word; words >> word;)
+            {
+                args.push_back(word);
+            }
+        }
+
+        for (unsigned long i = 0; i < repeat && !stopping; ++i)
+        {
+            if (!command.handler(args, output))
+            {
+                output << "error: '" << name << "' failed" << std::endl;
+                return false;
+            }
+        }
+        start = end + 1;
+    }
+    return true;
+}
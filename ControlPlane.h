@@ -0,0 +1,129 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_CONTROLPLANE_H
+#define MASTER_CONTROLPLANE_H
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Line-oriented command interface driven by a single epoll loop on the main thread.
+ *
+ * Commands arrive on an input descriptor, normally stdin, and on any number of connections to
+ * an optional Unix-domain socket. Nothing blocks: input is read only when epoll reports it ready
+ * and replies are queued until the connection can take them. A closed stdin is simply no longer
+ * watched, so the program keeps running headless until a quit command, SIGINT or SIGTERM.
+ *
+ * A line holds one or more commands separated by ';'. A command is a name followed by
+ * whitespace-separated arguments, optionally prefixed by a repeat count:
+ *
+ *   i; 100*e; stats
+ *
+ * runs an integrity scan, demands 100 exception scans back to back and prints statistics.
+ * Output goes to whoever sent the line. Socket clients also get a final "ok" or "error ..."
+ * line for every line they send, so scripts can wait for each one to finish. A command that
+ * fails ends the line with an error and the commands after it are not run.
+ */
+class ControlPlane
+{
+public:
+    /// @return false if the command failed, after writing the reason to output
+    using Handler = std::function<bool(const std::vector<std::string>& args, std::ostream& output)>;
+
+    ControlPlane();
+
+    /// Closes every descriptor and removes the socket file
+    ~ControlPlane();
+
+    ControlPlane(const ControlPlane&) = delete;
+    ControlPlane& operator=(const ControlPlane&) = delete;
+
+    /**
+     * Register a command
+     *
+     * @param names the command name and its aliases, separated by '|'
+     * @param help one line shown by the built-in "help" command
+     * @param handler receives the arguments after the name and the stream to reply on
+     */
+    void Add(const std::string& names, const std::string& help, Handler handler);
+
+    /**
+     * Register a command whose argument is taken verbatim rather than split on whitespace, for
+     * paths and inline JSON. The handler receives the text up to the next ';', trimmed, as its
+     * single argument, or no argument if there is none. An argument starting with '{' or '['
+     * is JSON and runs to the end of the line, ';' included.
+     */
+    void AddRaw(const std::string& names, const std::string& help, Handler handler);
+
+    /// Read commands from a descriptor, replies go to stdout
+    void WatchInput(int fd);
+
+    /// @return false with a description in errors if the socket could not be created
+    bool Listen(const std::string& path, std::string& errors);
+
+    /// Dispatch commands until Stop is called from a handler or the process is signalled
+    void Run();
+
+    void Stop();
+
+    void PrintHelp(std::ostream& output) const;
+
+private:
+    struct Connection
+    {
+        std::string input;
+        std::string output;
+        bool framed = false; // send "ok" or "error" after each line
+        bool closing = false;
+    };
+
+    struct Command
+    {
+        std::string help;
+        Handler handler;
+        bool raw = false; // takes the rest of the line as one argument
+    };
+
+    void Accept();
+    void Read(int fd);
+    void Write(int fd);
+    void Close(int fd);
+    void Update(int fd);
+
+    /// @return false with a reason in output if a command was not found, a count is invalid or a command failed
+    bool Execute(const std::string& line, std::ostream& output);
+
+    int epoll = -1;
+    int listener = -1;
+    int input = -1;
+    bool inputIsFile = false; // regular files cannot be polled, they are read until exhausted
+    int signals[2] = {-1, -1};
+    std::string socketPath;
+    bool stopping = false;
+
+    std::map<int, Connection> connections;
+    std::vector<std::pair<std::string, Command>> commands; // in the order they were added
+    std::map<std::string, size_t> byName;                  // every name and alias, into commands
+};
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ConvertKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MASTER_KERNEL_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define MASTER_KERNEL_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+namespace
+{
+
+void ConvertScalar(const double* raw,
+                   const double* scale,
+                   const double* offset,
+                   const double* minimum,
+                   const double* maximum,
+                   double* value,
+                   uint8_t* flags,
+                   size_t first,
+                   size_t count,
+                   uint8_t overrange)
+{
+    for (size_t i = first; i < count; ++i)
+    {
+        const double converted = raw[i] * scale[i] + offset[i];
+        if (converted < minimum[i])
+        {
+            value[i] = minimum[i];
+            flags[i] |= overrange;
+        }
+        else if (converted > maximum[i])
+        {
+            value[i] = maximum[i];
+            flags[i] |= overrange;
+        }
+        else
+        {
+            value[i] = converted;
+        }
+    }
+}
+
+#ifndef MASTER_KERNEL_SSE2
+
+void ConvertPortable(const double* raw,
+                     const double* scale,
+                     const double* offset,
+                     const double* minimum,
+                     const double* maximum,
+                     double* value,
+                     uint8_t* flags,
+                     size_t count,
+                     uint8_t overrange)
+{
+    ConvertScalar(raw, scale, offset, minimum, maximum, value, flags, 0, count, overrange);
+}
+
+#else
+
+// SSE2 has no blend, so the clamp selects with and/andnot/or
+void ConvertSse2(const double* raw,
+                 const double* scale,
+                 const double* offset,
+                 const double* minimum,
+                 const double* maximum,
+                 double* value,
+                 uint8_t* flags,
+                 size_t count,
+                 uint8_t overrange)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d converted = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(raw + i), _mm_loadu_pd(scale + i)),
+                                             _mm_loadu_pd(offset + i));
+        const __m128d low = _mm_loadu_pd(minimum + i);
+        const __m128d high = _mm_loadu_pd(maximum + i);
+
+        const __m128d below = _mm_cmplt_pd(converted, low);
+        const __m128d above = _mm_cmpgt_pd(converted, high);
+        const __m128d outside = _mm_or_pd(below, above);
+
+        __m128d result = _mm_andnot_pd(outside, converted);
+        result = _mm_or_pd(result, _mm_and_pd(below, low));
+        result = _mm_or_pd(result, _mm_and_pd(above, high));
+        _mm_storeu_pd(value + i, result);
+
+        const int clamped = _mm_movemask_pd(outside);
+        if (clamped)
+        {
+            flags[i] |= (clamped & 1) ? overrange : 0;
+            flags[i + 1] |= (clamped & 2) ? overrange : 0;
+        }
+    }
+
+    ConvertScalar(raw, scale, offset, minimum, maximum, value, flags, i, count, overrange);
+}
+
+#endif
+
+#ifdef MASTER_KERNEL_AVX2
+
+__attribute__((target("avx2"))) void ConvertAvx2(const double* raw,
+                                                 const double* scale,
+                                                 const double* offset,
+                                                 const double* minimum,
+                                                 const double* maximum,
+                                                 double* value,
+                                                 uint8_t* flags,
+                                                 size_t count,
+                                                 uint8_t overrange)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d converted = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(raw + i), _mm256_loadu_pd(scale + i)),
+                                                _mm256_loadu_pd(offset + i));
+        const __m256d low = _mm256_loadu_pd(minimum + i);
+        const __m256d high = _mm256_loadu_pd(maximum + i);
+
+        // ordered, non-signalling compares are false for NaN, which therefore passes through
+        const __m256d below = _mm256_cmp_pd(converted, low, _CMP_LT_OQ);
+        const __m256d above = _mm256_cmp_pd(converted, high, _CMP_GT_OQ);
+
+        __m256d result = _mm256_blendv_pd(converted, low, below);
+        result = _mm256_blendv_pd(result, high, above);
+        _mm256_storeu_pd(value + i, result);
+
+        const int clamped = _mm256_movemask_pd(_mm256_or_pd(below, above));
+        if (clamped)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                flags[i + lane] |= (clamped & (1 << lane)) ? overrange : 0;
+            }
+        }
+    }
+
+    ConvertScalar(raw, scale, offset, minimum, maximum, value, flags, i, count, overrange);
+}
+
+#endif
+
+using Kernel = void (*)(const double*,
+                        const double*,
+                        const double*,
+                        const double*,
+                        const double*,
+                        double*,
+                        uint8_t*,
+                        size_t,
+                        uint8_t);
+
+struct Selected
+{
+    Kernel kernel;
+    const char* name;
+};
+
+Selected Select()
+{
+#ifdef MASTER_KERNEL_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {ConvertAvx2, "avx2"};
+    }
+#endif
+#ifdef MASTER_KERNEL_SSE2
+    return {ConvertSse2, "sse2"};
+#else
+    return {ConvertPortable, "scalar"};
+#endif
+}
+
+// chosen once, before main
+const Selected selected = Select();
+
+} // namespace
+
+void ConvertBatch(const double* raw,
+                  const double* scale,
+                  const double* offset,
+                  const double* minimum,
+                  const double* maximum,
+                  double* value,
+                  uint8_t* flags,
+                  size_t count,
+                  uint8_t overrange)
+{
+    selected.kernel(raw, scale, offset, minimum, maximum, value, flags, count, overrange);
+}
+
+const char* ConvertKernelName()
+{
+    return selected.name;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_CONVERTKERNEL_H
+#define MASTER_CONVERTKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Converts a batch of raw values in place of a per-point loop:
+ *
+ *   value[i] = clamp(raw[i] * scale[i] + offset[i], minimum[i], maximum[i])
+ *
+ * A sample that had to be clamped gets overrange ORed into its flags, pass 0 for types without
+ * such a flag. NaN is neither clamped nor flagged.
+ *
+ * The AVX2 or SSE2 implementation is picked once from what the CPU supports, with a scalar loop
+ * for other targets and for the tail of each batch.
+ */
+void ConvertBatch(const double* raw,
+                  const double* scale,
+                  const double* offset,
+                  const double* minimum,
+                  const double* maximum,
+                  double* value,
+                  uint8_t* flags,
+                  size_t count,
+                  uint8_t overrange);
+
+/// @return "avx2", "sse2" or "scalar", whichever ConvertBatch uses on this machine
+const char* ConvertKernelName();
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_HISTOGRAM_H
+#define MASTER_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct HistogramSnapshot;
+
+/**
+ * Log-linear histogram of unsigned values in the style of HdrHistogram.
+ *
+ * Values below 16 get a bucket each. Every power of two above that is split into 16 linear
+ * sub-buckets, so any recorded value is known to within 1/16 (about 6%) over the full 64-bit
+ * range, in under 1000 fixed buckets.
+ *
+ * Record must only be called from one thread. Any thread may take a snapshot at any time
+ * without blocking the writer; a snapshot taken during a Record may miss that one value.
+ */
+class Histogram
+{
+public:
+    static const size_t SUB_BUCKET_BITS = 4;
+    static const size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void Record(uint64_t value)
+    {
+        Increment(buckets[BucketOf(value)], 1);
+        if (value > max.load(std::memory_order_relaxed))
+        {
+            max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /// Adds the current contents to a snapshot, which may already hold other histograms
+    void AddTo(HistogramSnapshot& snapshot) const;
+
+    static size_t BucketOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        const auto msb = static_cast<size_t>(63 - __builtin_clzll(value));
+        const auto shift = msb - SUB_BUCKET_BITS;
+        return ((shift + 1) << SUB_BUCKET_BITS) + static_cast<size_t>((value >> shift) - SUB_BUCKETS);
+    }
+
+    /// @return the highest value that falls into a bucket
+    static uint64_t UpperBoundOf(size_t bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+
+        const auto shift = (bucket >> SUB_BUCKET_BITS) - 1;
+        const auto base = static_cast<uint64_t>((bucket & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+        return base + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    // single writer, so a plain load and store is enough and avoids a locked instruction
+    static void Increment(std::atomic<uint64_t>& counter, uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> max{0};
+};
+
+/**
+ * Plain copy of one or more histograms, for computing percentiles off the recording threads
+ */
+struct HistogramSnapshot
+{
+    std::array<uint64_t, Histogram::BUCKETS> buckets{};
+    uint64_t count = 0;
+    uint64_t max = 0;
+
+    /// @param quantile between 0 and 1
+    /// @return upper bound of the bucket holding the value at the quantile, 0 if empty
+    uint64_t Percentile(double quantile) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        auto rank = static_cast<uint64_t>(quantile * static_cast<double>(count));
+        if (rank >= count)
+        {
+            rank = count - 1;
+        }
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+            {
+                const auto bound = Histogram::UpperBoundOf(i);
+                return bound < max ? bound : max;
+            }
+        }
+        return max;
+    }
+};
+
+inline void Histogram::AddTo(HistogramSnapshot& snapshot) const
+{
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        const auto value = buckets[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] += value;
+        snapshot.count += value;
+    }
+
+    const auto highest = max.load(std::memory_order_relaxed);
+    if (highest > snapshot.max)
+    {
+        snapshot.max = highest;
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "JsonReadingSink.h"
+
+#include <cmath>
+
+JsonReadingSink::JsonReadingSink(FILE* output) : output(output), writer(buffer) {}
+
+void JsonReadingSink::Append(const Reading& reading)
+{
+    if (pending == 0)
+    {
+        buffer.Clear();
+        writer.Reset(buffer);
+        writer.StartArray();
+    }
+
+    writer.StartObject();
+    writer.Key("asset");
+    writer.String(reading.asset);
+    writer.Key("timestamp");
+    writer.Uint64(reading.timestamp);
+    writer.Key("readings");
+    writer.StartObject();
+    writer.Key(reading.name);
+    if (std::isfinite(reading.value))
+    {
+        writer.Double(reading.value);
+        writer.EndObject();
+    }
+    else
+    {
+        // JSON has no NaN or infinity and Writer::Double would refuse it after the key is out,
+        // so the value is null and the flags say why
+        writer.Null();
+        writer.EndObject();
+        writer.Key("flags");
+        writer.Uint(reading.flags);
+    }
+    writer.EndObject();
+
+    ++pending;
+}
+
+void JsonReadingSink::Flush()
+{
+    if (pending == 0)
+    {
+        return;
+    }
+
+    writer.EndArray();
+    buffer.Put('\n');
+
+    fwrite(buffer.GetString(), 1, buffer.GetSize(), output);
+    fflush(output);
+
+    pending = 0;
+}
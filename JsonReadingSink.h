@@ -0,0 +1,53 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_JSONREADINGSINK_H
+#define MASTER_JSONREADINGSINK_H
+
+#include "Reading.h"
+
+#include "lib/include/rapidjson/stringbuffer.h"
+#include "lib/include/rapidjson/writer.h"
+
+#include <cstdio>
+
+/**
+ * Formats each batch of readings as one JSON array and writes it with a single call.
+ *
+ * The buffer and writer are reused between batches, so once they have grown to the
+ * size of the largest fragment no further allocation happens.
+ *
+ * A NaN or infinite value is written as null, with the reading's quality flags next to it.
+ */
+class JsonReadingSink final : public IReadingSink
+{
+public:
+    explicit JsonReadingSink(FILE* output = stdout);
+
+    void Append(const Reading& reading) override;
+    void Flush() override;
+
+private:
+    FILE* output;
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer;
+    size_t pending = 0;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_MEASUREMENTTRAITS_H
+#define MASTER_MEASUREMENTTRAITS_H
+
+#include "PointType.h"
+
+#include <opendnp3/app/MeasurementTypes.h>
+
+/**
+ * Compile-time description of how to read a measurement type.
+ *
+ * Every measurement carries flags and a device timestamp the same way, so the specializations
+ * only name the point type, how the value widens to a double and which flag marks a value
+ * outside its range.
+ */
+template<class T> struct MeasurementTraits;
+
+template<class T, PointType TYPE> struct TypedMeasurementTraits
+{
+    static const PointType pointType = TYPE;
+
+    /// quality bit set on a value clamped to its configured range, 0 if the type has none
+    static const uint8_t overrange = 0;
+
+    static double Value(const T& meas)
+    {
+        return static_cast<double>(meas.value);
+    }
+
+    static uint8_t Flags(const T& meas)
+    {
+        return meas.flags.value;
+    }
+
+    static uint64_t Timestamp(const T& meas)
+    {
+        return meas.time.value;
+    }
+
+    /// @return false for a measurement sent without a usable time, like the static objects of an integrity poll
+    static bool HasTime(const T& meas)
+    {
+        return meas.time.value != 0 && meas.time.quality != opendnp3::TimestampQuality::INVALID;
+    }
+};
+
+template<> struct MeasurementTraits<opendnp3::Binary> : TypedMeasurementTraits<opendnp3::Binary, PointType::Binary>
+{
+};
+
+template<>
+struct MeasurementTraits<opendnp3::DoubleBitBinary>
+    : TypedMeasurementTraits<opendnp3::DoubleBitBinary, PointType::DoubleBitBinary>
+{
+    static double Value(const opendnp3::DoubleBitBinary& meas)
+    {
+        // the on-the-wire state, 0 to 3
+        return static_cast<double>(static_cast<uint8_t>(meas.value));
+    }
+};
+
+template<> struct MeasurementTraits<opendnp3::Analog> : TypedMeasurementTraits<opendnp3::Analog, PointType::Analog>
+{
+    static const uint8_t overrange = 0x20; // AnalogQuality::OVERRANGE
+};
+
+template<> struct MeasurementTraits<opendnp3::Counter> : TypedMeasurementTraits<opendnp3::Counter, PointType::Counter>
+{
+};
+
+template<>
+struct MeasurementTraits<opendnp3::FrozenCounter>
+    : TypedMeasurementTraits<opendnp3::FrozenCounter, PointType::FrozenCounter>
+{
+};
+
+template<>
+struct MeasurementTraits<opendnp3::BinaryOutputStatus>
+    : TypedMeasurementTraits<opendnp3::BinaryOutputStatus, PointType::BinaryOutputStatus>
+{
+};
+
+template<>
+struct MeasurementTraits<opendnp3::AnalogOutputStatus>
+    : TypedMeasurementTraits<opendnp3::AnalogOutputStatus, PointType::AnalogOutputStatus>
+{
+    static const uint8_t overrange = 0x20; // AnalogOutputStatusQuality::OVERRANGE
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Metrics.h"
+
+#include "lib/include/rapidjson/stringbuffer.h"
+#include "lib/include/rapidjson/writer.h"
+
+using namespace rapidjson;
+
+void MetricsReport::Add(const std::string& name, const Histogram& histogram)
+{
+    for (auto& entry : entries)
+    {
+        if (entry.first == name)
+        {
+            histogram.AddTo(entry.second);
+            return;
+        }
+    }
+
+    entries.emplace_back(name, HistogramSnapshot());
+    histogram.AddTo(entries.back().second);
+}
+
+void MetricsReport::Print(std::ostream& output) const
+{
+    for (const auto& entry : entries)
+    {
+        const auto& snapshot = entry.second;
+        output << entry.first << ": count " << snapshot.count << ", p50 " << snapshot.Percentile(0.5) << ", p99 "
+               << snapshot.Percentile(0.99) << ", max " << snapshot.max << std::endl;
+    }
+}
+
+std::string MetricsReport::ToJson() const
+{
+    StringBuffer buffer;
+    Writer<StringBuffer> writer(buffer);
+
+    writer.StartObject();
+    for (const auto& entry : entries)
+    {
+        const auto& snapshot = entry.second;
+        writer.Key(entry.first.c_str());
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(snapshot.count);
+        writer.Key("p50");
+        writer.Uint64(snapshot.Percentile(0.5));
+        writer.Key("p99");
+        writer.Uint64(snapshot.Percentile(0.99));
+        writer.Key("max");
+        writer.Uint64(snapshot.max);
+        writer.EndObject();
+    }
+    writer.EndObject();
+
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+MetricsDumper::MetricsDumper(std::chrono::seconds period, std::function<std::string()> report, FILE* output)
+    : period(period), report(std::move(report)), output(output), worker([this]() { Run(); })
+{
+}
+
+MetricsDumper::~MetricsDumper()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    signal.notify_one();
+    worker.join();
+}
+
+void MetricsDumper::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!signal.wait_for(lock, period, [this]() { return stopping; }))
+    {
+        auto line = report();
+        line += '\n';
+        fwrite(line.data(), 1, line.size(), output);
+        fflush(output);
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_METRICS_H
+#define MASTER_METRICS_H
+
+#include "Histogram.h"
+#include "PointType.h"
+
+#include <opendnp3/master/ITaskCallback.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @return steady clock time in nanoseconds, for measuring intervals
+inline uint64_t SteadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/// @return wall clock time in milliseconds since epoch, comparable with DNP3 timestamps
+inline uint64_t WallMillis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Latency and size histograms for one master.
+ *
+ * Everything here is recorded from the stack thread currently servicing the master's channel,
+ * which keeps each histogram single-writer.
+ */
+struct MasterMetrics
+{
+    Histogram fragmentNs;                                // BeginFragment to EndFragment
+    Histogram pointsPerFragment;                         // points received, mapped or not
+    std::array<Histogram, POINT_TYPE_COUNT> processNs;   // one Process call, per point type
+    Histogram deviceLagMs;                               // wall clock minus device timestamp, per point
+    Histogram integrityScanMs;                           // integrity poll, start to completion
+    Histogram eventScanMs;                               // Class 1 poll, start to completion
+    Histogram commandMs;                                 // command queued to result
+};
+
+/**
+ * Task callback that records how long each run of a scan takes, in milliseconds
+ */
+class ScanTimer final : public opendnp3::ITaskCallback
+{
+public:
+    explicit ScanTimer(std::shared_ptr<Histogram> durations) : durations(std::move(durations)) {}
+
+    void OnStart() override
+    {
+        started = std::chrono::steady_clock::now();
+    }
+
+    void OnComplete(opendnp3::TaskCompletion) override
+    {
+        durations->Record(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)
+                             .count());
+    }
+
+    void OnDestroyed() override {}
+
+private:
+    const std::shared_ptr<Histogram> durations;
+    std::chrono::steady_clock::time_point started;
+};
+
+/**
+ * Named histogram snapshots, merged across masters under the same name
+ */
+class MetricsReport
+{
+public:
+    void Add(const std::string& name, const Histogram& histogram);
+
+    /// One line per histogram with count, p50, p99 and max
+    void Print(std::ostream& output) const;
+
+    /// A single line JSON object keyed by histogram name
+    std::string ToJson() const;
+
+private:
+    std::vector<std::pair<std::string, HistogramSnapshot>> entries;
+};
+
+/**
+ * Calls a report function on a background thread at a fixed period and writes its result
+ */
+class MetricsDumper
+{
+public:
+    MetricsDumper(std::chrono::seconds period, std::function<std::string()> report, FILE* output);
+    ~MetricsDumper();
+
+    MetricsDumper(const MetricsDumper&) = delete;
+    MetricsDumper& operator=(const MetricsDumper&) = delete;
+
+private:
+    void Run();
+
+    const std::chrono::seconds period;
+    const std::function<std::string()> report;
+    FILE* output;
+
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif
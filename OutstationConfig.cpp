@@ -0,0 +1,126 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "OutstationConfig.h"
+
+#include "RegisterMapLoader.h"
+
+#include "lib/include/rapidjson/error/en.h"
+
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+using namespace rapidjson;
+
+static bool GetUInt16(const Value& entry, const char* key, uint16_t& value)
+{
+    if (!entry.HasMember(key))
+    {
+        return true; // keep the default
+    }
+
+    const auto& member = entry[key];
+    if (!member.IsInt() || member.GetInt() < 0 || member.GetInt() > std::numeric_limits<uint16_t>::max())
+    {
+        return false;
+    }
+
+    value = static_cast<uint16_t>(member.GetInt());
+    return true;
+}
+
+std::vector<OutstationConfig> OutstationConfig::BuildList(const Value& values, std::string& errors)
+{
+    std::vector<OutstationConfig> list;
+
+    if (!values.IsArray())
+    {
+        errors += "outstation list \"values\" is not an array\n";
+        return list;
+    }
+
+    for (auto& entry : values.GetArray())
+    {
+        if (!entry.IsObject() || !entry.HasMember("id") || !entry.HasMember("address") || !entry["address"].IsString())
+        {
+            errors += "outstation entry without an id or address\n";
+            continue;
+        }
+
+        OutstationConfig config;
+        config.host = entry["address"].GetString();
+
+        if (!GetUInt16(entry, "id", config.id) || !GetUInt16(entry, "port", config.port)
+            || !GetUInt16(entry, "localAddr", config.localAddr) || !GetUInt16(entry, "remoteAddr", config.remoteAddr))
+        {
+            errors += config.host + ": \"id\", \"port\", \"localAddr\" and \"remoteAddr\" must be integers from 0 to 65535\n";
+            continue;
+        }
+
+        bool duplicate = false;
+        for (const auto& other : list)
+        {
+            duplicate |= (other.id == config.id);
+        }
+        if (duplicate)
+        {
+            errors += config.host + ": outstation id " + std::to_string(config.id) + " is already in use\n";
+            continue;
+        }
+
+        list.push_back(config);
+    }
+
+    return list;
+}
+
+std::vector<OutstationConfig> OutstationConfig::Load(const std::string& source, std::string& errors)
+{
+    std::string text;
+    if (RegisterMapLoader::IsInline(source))
+    {
+        text = source;
+    }
+    else
+    {
+        std::ifstream file(source, std::ios::binary);
+        if (!file)
+        {
+            errors += "outstations: cannot open " + source + "\n";
+            return {};
+        }
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    Document list;
+    if (list.Parse(text.c_str()).HasParseError())
+    {
+        errors += std::string("outstations: ") + GetParseError_En(list.GetParseError()) + " at offset "
+            + std::to_string(list.GetErrorOffset()) + "\n";
+        return {};
+    }
+    if (!list.IsObject() || !list.HasMember("values") || !list["values"].IsArray())
+    {
+        errors += "outstations: no \"values\" array\n";
+        return {};
+    }
+
+    return BuildList(list["values"], errors);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_OUTSTATIONCONFIG_H
+#define MASTER_OUTSTATIONCONFIG_H
+
+#include "lib/include/rapidjson/document.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * One outstation to poll, compiled from one entry of the "outstations" list.
+ *
+ * The id is what register map entries refer to with "out-station".
+ */
+struct OutstationConfig
+{
+    uint16_t id = 1;
+    std::string host = "127.0.0.1";
+    uint16_t port = 20000;
+    uint16_t localAddr = 1;
+    uint16_t remoteAddr = 10;
+
+    /// @return a name for the channel and master of this outstation, used in the logs
+    std::string Name() const
+    {
+        return "outstation-" + std::to_string(id);
+    }
+
+    /**
+     * Compile the "values" array of an outstation list.
+     *
+     * @param values JSON array of entries, each with at least "id" and "address"
+     * @param errors receives one line per rejected entry
+     */
+    static std::vector<OutstationConfig> BuildList(const rapidjson::Value& values, std::string& errors);
+
+    /**
+     * Read and compile an outstation list, { "values" : [ ... ] }
+     *
+     * @param source the list JSON itself, or the path of a file holding it
+     * @param errors receives a parse or file error, or one line per rejected entry
+     */
+    static std::vector<OutstationConfig> Load(const std::string& source, std::string& errors);
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_POINTTYPE_H
+#define MASTER_POINTTYPE_H
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * The measurement types a register map entry can refer to.
+ *
+ * DNP3 numbers points separately per type, so the type and the index together identify a point.
+ */
+enum class PointType : uint8_t
+{
+    Binary,
+    DoubleBitBinary,
+    Analog,
+    Counter,
+    FrozenCounter,
+    BinaryOutputStatus,
+    AnalogOutputStatus
+};
+
+static const size_t POINT_TYPE_COUNT = 7;
+
+/// @return the name used for a type in the "type" field of the register map
+inline const char* PointTypeName(PointType type)
+{
+    switch (type)
+    {
+    case PointType::Binary:
+        return "binary";
+    case PointType::DoubleBitBinary:
+        return "doubleBitBinary";
+    case PointType::Analog:
+        return "analog";
+    case PointType::Counter:
+        return "counter";
+    case PointType::FrozenCounter:
+        return "frozenCounter";
+    case PointType::BinaryOutputStatus:
+        return "binaryOutputStatus";
+    default:
+        return "analogOutputStatus";
+    }
+}
+
+/// @return false if the name is not one returned by PointTypeName
+inline bool ParsePointType(const char* name, PointType& type)
+{
+    for (size_t i = 0; i < POINT_TYPE_COUNT; ++i)
+    {
+        if (strcmp(name, PointTypeName(static_cast<PointType>(i))) == 0)
+        {
+            type = static_cast<PointType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "QueuedReadingSink.h"
+
+#include <chrono>
+#include <thread>
+
+QueuedReadingSink::QueuedReadingSink(std::shared_ptr<IReadingSink> downstream,
+                                     const QueueConfig& config,
+                                     ServiceThread& consumer)
+    : downstream(std::move(downstream)), queue(config.capacity, config.policy), consumer(consumer)
+{
+    consumer.Add(this);
+}
+
+QueuedReadingSink::~QueuedReadingSink()
+{
+    consumer.Remove(this);
+    while (Drain(queue.Capacity()))
+    {
+    }
+}
+
+void QueuedReadingSink::Append(const Reading& reading)
+{
+    // only fails under OverflowPolicy::Block, so wake the consumer and wait for room
+    while (!queue.Push(reading))
+    {
+        consumer.Wake();
+        std::this_thread::yield();
+    }
+}
+
+void QueuedReadingSink::Flush()
+{
+    consumer.Wake();
+}
+
+IService::Clock::time_point QueuedReadingSink::Service(Clock::time_point now)
+{
+    // one queue's worth per pass, so a busy master cannot starve the others on the thread
+    return Drain(queue.Capacity()) ? now : Clock::time_point::max();
+}
+
+bool QueuedReadingSink::Drain(size_t limit)
+{
+    Reading reading;
+    size_t count = 0;
+    uint64_t oldest = 0;
+
+    while (count < limit && queue.Pop(reading))
+    {
+        if (count == 0)
+        {
+            oldest = reading.received;
+        }
+        downstream->Append(reading);
+        ++count;
+    }
+
+    if (count > 0)
+    {
+        downstream->Flush();
+
+        const uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch())
+                                 .count();
+        deliveryUs.Record(now > oldest ? (now - oldest) / 1000 : 0);
+    }
+
+    return count == limit;
+}
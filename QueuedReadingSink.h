@@ -0,0 +1,81 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_QUEUEDREADINGSINK_H
+#define MASTER_QUEUEDREADINGSINK_H
+
+#include "Histogram.h"
+#include "ReadingQueue.h"
+#include "ServicePool.h"
+
+#include <memory>
+
+struct QueueConfig
+{
+    /// number of readings that can be queued, rounded up to a power of two
+    size_t capacity = 4096;
+
+    OverflowPolicy policy = OverflowPolicy::DropOldest;
+};
+
+/**
+ * Moves readings off the stack's thread into a ReadingQueue and drains them to another
+ * sink from a ServiceThread shared with other sinks.
+ *
+ * Append and Flush must be called from a single producer thread. The downstream sink is
+ * only touched by the service thread, which flushes it whenever the queue runs empty.
+ */
+class QueuedReadingSink final : public IReadingSink, private IService
+{
+public:
+    QueuedReadingSink(std::shared_ptr<IReadingSink> downstream, const QueueConfig& config, ServiceThread& consumer);
+
+    /// Detaches from the service thread and drains whatever is still queued
+    ~QueuedReadingSink() override;
+
+    QueuedReadingSink(const QueuedReadingSink&) = delete;
+    QueuedReadingSink& operator=(const QueuedReadingSink&) = delete;
+
+    void Append(const Reading& reading) override;
+    void Flush() override;
+
+    const ReadingQueue& Queue() const
+    {
+        return queue;
+    }
+
+    /// Time from a fragment's arrival to the downstream flush that emitted it, in microseconds
+    const Histogram& DeliveryMicros() const
+    {
+        return deliveryUs;
+    }
+
+private:
+    Clock::time_point Service(Clock::time_point now) override;
+
+    /// Move at most limit readings downstream. @return true if the queue may still hold more
+    bool Drain(size_t limit);
+
+    std::shared_ptr<IReadingSink> downstream;
+    ReadingQueue queue;
+    Histogram deliveryUs;
+    ServiceThread& consumer;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_READING_H
+#define MASTER_READING_H
+
+#include "PointType.h"
+
+#include <cstdint>
+
+/**
+ * A single converted point, as handed from the SOE handler to a reading sink.
+ *
+ * Fixed size and trivially copyable. The name and asset point into the register map.
+ */
+struct Reading
+{
+    uint64_t timestamp = 0; // device time, or arrival time if the device sent none, milliseconds since epoch
+    uint64_t received = 0;  // steady clock when the fragment arrived, nanoseconds
+    const char* name = nullptr;
+    const char* asset = nullptr;
+    PointType type = PointType::Analog;
+    uint16_t index = 0;
+    uint8_t flags = 0;
+    double raw = 0.0;
+    double value = 0.0;
+};
+
+/**
+ * Destination for readings produced by the SOE handler.
+ *
+ * Readings are appended one at a time and flushed once per response fragment.
+ * Implementations are driven from a single thread.
+ */
+class IReadingSink
+{
+public:
+    virtual ~IReadingSink() = default;
+
+    virtual void Append(const Reading& reading) = 0;
+
+    /// Emit everything appended since the last flush
+    virtual void Flush() = 0;
+};
+
+#endif
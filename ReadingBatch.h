@@ -0,0 +1,90 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_READINGBATCH_H
+#define MASTER_READINGBATCH_H
+
+#include "ConvertKernel.h"
+#include "RegisterMap.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * The mapped points of one measurement header, one column per field, so that ConvertBatch
+ * can run over the whole header at once.
+ *
+ * The columns keep their capacity across Clear, so a handler that reuses one batch stops
+ * allocating once it has seen its largest header.
+ */
+class ReadingBatch
+{
+public:
+    void Clear()
+    {
+        points.clear();
+        indices.clear();
+        timestamps.clear();
+        flags.clear();
+        raw.clear();
+        scale.clear();
+        offset.clear();
+        minimum.clear();
+        maximum.clear();
+    }
+
+    void Add(const PointConfig& point, uint16_t index, double rawValue, uint8_t pointFlags, uint64_t timestamp)
+    {
+        points.push_back(&point);
+        indices.push_back(index);
+        timestamps.push_back(timestamp);
+        flags.push_back(pointFlags);
+        raw.push_back(rawValue);
+        scale.push_back(point.scale);
+        offset.push_back(point.offset);
+        minimum.push_back(point.minimum);
+        maximum.push_back(point.maximum);
+    }
+
+    /// Fill in the converted values, see ConvertBatch
+    void Convert(uint8_t overrange)
+    {
+        values.resize(raw.size());
+        ConvertBatch(raw.data(), scale.data(), offset.data(), minimum.data(), maximum.data(), values.data(),
+                     flags.data(), raw.size(), overrange);
+    }
+
+    size_t Size() const
+    {
+        return points.size();
+    }
+
+    std::vector<const PointConfig*> points;
+    std::vector<uint16_t> indices;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint8_t> flags;
+    std::vector<double> raw;
+    std::vector<double> scale;
+    std::vector<double> offset;
+    std::vector<double> minimum;
+    std::vector<double> maximum;
+    std::vector<double> values; // written by Convert
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_READINGQUEUE_H
+#define MASTER_READINGQUEUE_H
+
+#include "Reading.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+/**
+ * What the producer does when the queue is full
+ */
+enum class OverflowPolicy : uint8_t
+{
+    /// discard the oldest queued reading to make room for the new one
+    DropOldest,
+    /// wait for the consumer to make room
+    Block
+};
+
+/**
+ * Bounded lock-free ring of readings with exactly one producer and one consumer thread.
+ *
+ * The capacity is rounded up to a power of two. Under DropOldest the producer may advance
+ * the read index itself, so the consumer claims each slot with a compare-exchange and
+ * discards its copy if the producer got there first. Slots are stored as relaxed atomic words,
+ * so the producer overwriting a slot the consumer is still copying is a torn copy that gets
+ * discarded, not a data race.
+ */
+class ReadingQueue
+{
+public:
+    ReadingQueue(size_t capacity, OverflowPolicy policy)
+        : size(RoundUp(capacity)), slots(new Slot[size]), mask(size - 1), policy(policy)
+    {
+    }
+
+    ReadingQueue(const ReadingQueue&) = delete;
+    ReadingQueue& operator=(const ReadingQueue&) = delete;
+
+    /// Producer side. @return false if the queue is full under Block and the reading was not queued
+    bool Push(const Reading& reading)
+    {
+        const auto head = writeIndex.load(std::memory_order_relaxed);
+
+        auto tail = readIndex.load(std::memory_order_acquire);
+        if (head - tail == size)
+        {
+            if (policy == OverflowPolicy::Block)
+            {
+                return false;
+            }
+
+            // on failure the consumer just freed a slot
+            if (readIndex.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel))
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        Store(slots[head & mask], reading);
+        writeIndex.store(head + 1, std::memory_order_release);
+
+        const auto depth = head + 1 - readIndex.load(std::memory_order_relaxed);
+        if (depth > highWater.load(std::memory_order_relaxed))
+        {
+            highWater.store(depth, std::memory_order_relaxed);
+        }
+
+        return true;
+    }
+
+    /// Consumer side. @return false if the queue is empty
+    bool Pop(Reading& reading)
+    {
+        auto tail = readIndex.load(std::memory_order_acquire);
+        while (tail != writeIndex.load(std::memory_order_acquire))
+        {
+            Load(slots[tail & mask], reading);
+            if (readIndex.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t Capacity() const
+    {
+        return size;
+    }
+
+    /// @return number of readings discarded under DropOldest
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /// @return the largest number of readings queued at once
+    uint64_t HighWater() const
+    {
+        return highWater.load(std::memory_order_relaxed);
+    }
+
+private:
+    static_assert(std::is_trivially_copyable<Reading>::value, "readings are copied word by word");
+
+    static const size_t WORDS = (sizeof(Reading) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct Slot
+    {
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    static void Store(Slot& slot, const Reading& reading)
+    {
+        uint64_t words[WORDS] = {};
+        memcpy(words, &reading, sizeof(Reading));
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    static void Load(const Slot& slot, Reading& reading)
+    {
+        uint64_t words[WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        memcpy(&reading, words, sizeof(Reading));
+    }
+
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const size_t size;
+    std::unique_ptr<Slot[]> slots;
+    const uint64_t mask;
+    const OverflowPolicy policy;
+
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<uint64_t> writeIndex{0};
+    alignas(64) std::atomic<uint64_t> readIndex{0};
+
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> highWater{0};
+};
+
+#endif
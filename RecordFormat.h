@@ -0,0 +1,81 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_RECORDFORMAT_H
+#define MASTER_RECORDFORMAT_H
+
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * On-disk layout of a recording segment, shared by RecordingSink and RecordingReader.
+ *
+ * A segment is a SegmentHeader followed by chunks. Each chunk is a ChunkHeader followed by
+ * count fixed-width RecordEntry items, and holds the readings of one response fragment. Every
+ * structure is a multiple of 8 bytes with no implicit padding and is stored in host byte order,
+ * so a mapped segment can be read in place.
+ */
+
+/// "DNP3REC" and a terminating zero, the first 8 bytes of every segment
+static const char SEGMENT_MAGIC[8] = {'D', 'N', 'P', '3', 'R', 'E', 'C', '\0'};
+
+static const uint32_t SEGMENT_VERSION = 1;
+
+/// "CHNK" in little-endian order, marks the start of every chunk
+static const uint32_t CHUNK_MAGIC = 0x4B4E4843;
+
+struct SegmentHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;  // sizeof(RecordEntry) when the segment was written
+    uint64_t created;     // wall clock, milliseconds since epoch
+    uint16_t outstation;
+    uint16_t reserved;
+    uint32_t sequence;    // position of the segment in its outstation's recording
+};
+
+struct ChunkHeader
+{
+    uint32_t magic;
+    uint32_t count;       // records that follow
+    uint64_t written;     // wall clock when the fragment was flushed, milliseconds since epoch
+};
+
+/**
+ * One recorded reading, 32 bytes
+ */
+struct RecordEntry
+{
+    uint64_t timestamp;   // device time, milliseconds since epoch
+    double raw;           // value as received
+    double value;         // value after scale and offset
+    uint16_t outstation;
+    uint16_t index;
+    uint8_t type;         // PointType
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(SegmentHeader) == 32, "segment header layout is part of the file format");
+static_assert(sizeof(ChunkHeader) == 16, "chunk header layout is part of the file format");
+static_assert(sizeof(RecordEntry) == 32, "record layout is part of the file format");
+static_assert(std::is_trivially_copyable<RecordEntry>::value, "records are written and mapped as raw bytes");
+
+#endif
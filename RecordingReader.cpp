@@ -0,0 +1,107 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "RecordingReader.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RecordingReader::~RecordingReader()
+{
+    Close();
+}
+
+void RecordingReader::Close()
+{
+    if (data)
+    {
+        munmap(const_cast<char*>(data), size);
+        data = nullptr;
+    }
+    size = valid = chunks = records = 0;
+}
+
+bool RecordingReader::Open(const std::string& path, std::string& errors)
+{
+    Close();
+
+    const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        errors += "cannot open " + path + ": " + strerror(errno) + "\n";
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SegmentHeader))
+    {
+        errors += path + " is too short to be a recording\n";
+        close(file);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED)
+    {
+        errors += "cannot map " + path + ": " + strerror(errno) + "\n";
+        return false;
+    }
+
+    data = static_cast<const char*>(mapping);
+    size = info.st_size;
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const auto& header = Header();
+    if (memcmp(header.magic, SEGMENT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        errors += path + " is not a recording\n";
+        Close();
+        return false;
+    }
+    if (header.version != SEGMENT_VERSION || header.recordSize != sizeof(RecordEntry))
+    {
+        errors += path + " has unsupported version " + std::to_string(header.version) + "\n";
+        Close();
+        return false;
+    }
+
+    // find the end of the last complete chunk
+    size_t offset = sizeof(SegmentHeader);
+    while (size - offset >= sizeof(ChunkHeader))
+    {
+        const auto& chunk = *reinterpret_cast<const ChunkHeader*>(data + offset);
+        if (chunk.magic != CHUNK_MAGIC || chunk.count > (size - offset - sizeof(ChunkHeader)) / sizeof(RecordEntry))
+        {
+            break;
+        }
+        offset += sizeof(ChunkHeader) + chunk.count * sizeof(RecordEntry);
+        records += chunk.count;
+        ++chunks;
+    }
+    valid = offset;
+
+    return true;
+}
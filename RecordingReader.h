@@ -0,0 +1,95 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_RECORDINGREADER_H
+#define MASTER_RECORDINGREADER_H
+
+#include "RecordFormat.h"
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only view of one recording segment, memory-mapped so records are scanned in place.
+ *
+ * Open validates the segment header and walks the chunk headers once. A partial or corrupt
+ * chunk ends the valid part of the segment, as left behind by a crash during a write, and
+ * everything before it stays readable.
+ */
+class RecordingReader
+{
+public:
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    /// @return false with a description in errors if the file is not a readable segment
+    bool Open(const std::string& path, std::string& errors);
+
+    const SegmentHeader& Header() const
+    {
+        return *reinterpret_cast<const SegmentHeader*>(data);
+    }
+
+    /// @return number of complete chunks
+    size_t Chunks() const
+    {
+        return chunks;
+    }
+
+    /// @return number of records in the complete chunks
+    size_t Records() const
+    {
+        return records;
+    }
+
+    /// @return true if bytes after the last complete chunk were ignored
+    bool Truncated() const
+    {
+        return valid < size;
+    }
+
+    /**
+     * Calls handler(const ChunkHeader&, const RecordEntry* records) for each complete chunk,
+     * in the order they were written. The records point into the mapping.
+     */
+    template<class Handler> void ForeachChunk(Handler&& handler) const
+    {
+        size_t offset = sizeof(SegmentHeader);
+        while (offset < valid)
+        {
+            const auto& chunk = *reinterpret_cast<const ChunkHeader*>(data + offset);
+            handler(chunk, reinterpret_cast<const RecordEntry*>(data + offset + sizeof(ChunkHeader)));
+            offset += sizeof(ChunkHeader) + chunk.count * sizeof(RecordEntry);
+        }
+    }
+
+private:
+    void Close();
+
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t valid = 0;
+    size_t chunks = 0;
+    size_t records = 0;
+};
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "RecordingSink.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+
+std::shared_ptr<RecordingSink> RecordingSink::Open(std::shared_ptr<IReadingSink> downstream,
+                                                   uint16_t outstation,
+                                                   const RecordingConfig& config,
+                                                   ServiceThread& syncer,
+                                                   std::string& errors)
+{
+    std::shared_ptr<RecordingSink> sink(new RecordingSink(std::move(downstream), outstation, config, syncer));
+
+    uint32_t first = 0;
+    std::string path;
+    sink->file = sink->OpenSegment(first, path, errors);
+    if (sink->file < 0)
+    {
+        return nullptr;
+    }
+
+    sink->segmentBytes = sizeof(SegmentHeader);
+    sink->bytes.store(sizeof(SegmentHeader), std::memory_order_relaxed);
+    sink->sequence.store(first, std::memory_order_relaxed);
+    sink->recording.store(true, std::memory_order_relaxed);
+    sink->nextSequence = first + 1;
+    sink->current = sink->file;
+
+    // prepares the spare segment right away
+    syncer.Add(sink.get());
+    return sink;
+}
+
+RecordingSink::RecordingSink(std::shared_ptr<IReadingSink> downstream,
+                             uint16_t outstation,
+                             const RecordingConfig& config,
+                             ServiceThread& syncer)
+    : downstream(std::move(downstream)),
+      outstation(outstation),
+      config(config),
+      syncer(syncer),
+      lastSync(Clock::now())
+{
+}
+
+RecordingSink::~RecordingSink()
+{
+    syncer.Remove(this);
+    WriteChunk();
+    Retire();
+
+    for (auto segment : retired)
+    {
+        fdatasync(segment);
+        close(segment);
+    }
+
+    // the spare never received a chunk, so leave no empty segment behind
+    if (spare >= 0)
+    {
+        close(spare);
+        unlink(sparePath.c_str());
+    }
+}
+
+void RecordingSink::Append(const Reading& reading)
+{
+    RecordEntry entry;
+    entry.timestamp = reading.timestamp;
+    entry.raw = reading.raw;
+    entry.value = reading.value;
+    entry.outstation = outstation;
+    entry.index = reading.index;
+    entry.type = static_cast<uint8_t>(reading.type);
+    entry.flags = reading.flags;
+    entry.reserved = 0;
+    pending.push_back(entry);
+
+    downstream->Append(reading);
+}
+
+void RecordingSink::Flush()
+{
+    WriteChunk();
+    downstream->Flush();
+}
+
+int RecordingSink::OpenSegment(uint32_t& next, std::string& path, std::string& errors) const
+{
+    // never overwrite an earlier recording, skip past any sequence number already taken
+    for (;; ++next)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "/outstation-%u-%06u.rec", outstation, next);
+        path = config.directory + name;
+
+        const int segment = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+        if (segment < 0 && errno == EEXIST)
+        {
+            continue;
+        }
+        if (segment < 0)
+        {
+            errors += "cannot create " + path + ": " + strerror(errno) + "\n";
+            return -1;
+        }
+
+        SegmentHeader header;
+        memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+        header.version = SEGMENT_VERSION;
+        header.recordSize = sizeof(RecordEntry);
+        header.created = WallMillis();
+        header.outstation = outstation;
+        header.reserved = 0;
+        header.sequence = next;
+
+        if (write(segment, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)))
+        {
+            errors += "cannot write " + path + ": " + strerror(errno) + "\n";
+            close(segment);
+            unlink(path.c_str());
+            return -1;
+        }
+
+        return segment;
+    }
+}
+
+IService::Clock::time_point RecordingSink::Service(Clock::time_point now)
+{
+    std::vector<int> closing;
+    int segment;
+    bool prepare;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing.swap(retired);
+        segment = current;
+        prepare = segment >= 0 && spare < 0;
+    }
+
+    for (auto full : closing)
+    {
+        fdatasync(full);
+        close(full);
+    }
+
+    if (prepare && recording.load(std::memory_order_relaxed))
+    {
+        uint32_t next = nextSequence;
+        std::string path;
+        std::string errors;
+        const int created = OpenSegment(next, path, errors);
+        if (created < 0)
+        {
+            fprintf(stderr, "recording stopped: %s", errors.c_str());
+            recording.store(false, std::memory_order_relaxed);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare = created;
+            spareSequence = next;
+            sparePath = path;
+            nextSequence = next + 1;
+        }
+    }
+
+    if (!dirty.load())
+    {
+        return Clock::time_point::max();
+    }
+
+    if (now - lastSync < config.syncInterval)
+    {
+        return lastSync + config.syncInterval;
+    }
+
+    // clear first, a write that lands after it marks the segment dirty again
+    dirty.store(false);
+    lastSync = now;
+    {
+        // a full segment the writer switched away from in the meantime is synced when it is closed
+        std::lock_guard<std::mutex> lock(mutex);
+        segment = current;
+    }
+
+    if (segment >= 0 && fdatasync(segment) != 0)
+    {
+        fprintf(stderr, "recording stopped, sync of segment %u failed: %s\n", sequence.load(std::memory_order_relaxed),
+                strerror(errno));
+        recording.store(false, std::memory_order_relaxed);
+    }
+    return Clock::time_point::max();
+}
+
+void RecordingSink::WriteChunk()
+{
+    if (file < 0 || pending.empty())
+    {
+        pending.clear();
+        return;
+    }
+
+    // the syncer failed, close the segment from here on
+    if (!recording.load(std::memory_order_relaxed))
+    {
+        Retire();
+        pending.clear();
+        syncer.Wake();
+        return;
+    }
+
+    ChunkHeader header;
+    header.magic = CHUNK_MAGIC;
+    header.count = static_cast<uint32_t>(pending.size());
+    header.written = WallMillis();
+
+    const size_t size = sizeof(header) + pending.size() * sizeof(RecordEntry);
+
+    // a fragment larger than a whole segment still gets a segment of its own
+    if (segmentBytes + size > config.maxSegmentBytes && segmentBytes > sizeof(SegmentHeader))
+    {
+        Rotate();
+    }
+
+    // header and records in one call, so a crash cannot interleave them with another chunk
+    iovec parts[2];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = pending.data();
+    parts[1].iov_len = pending.size() * sizeof(RecordEntry);
+
+    if (writev(file, parts, 2) != static_cast<ssize_t>(size))
+    {
+        Fail("write");
+        return;
+    }
+
+    segmentBytes += size;
+    records.store(records.load(std::memory_order_relaxed) + pending.size(), std::memory_order_relaxed);
+    bytes.store(bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    pending.clear();
+
+    // only the first write since the last sync wakes the syncer, it then waits out the interval itself
+    if (!dirty.exchange(true))
+    {
+        syncer.Wake();
+    }
+}
+
+void RecordingSink::Rotate()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spare < 0)
+        {
+            return;
+        }
+        retired.push_back(file);
+        file = spare;
+        current = spare;
+        spare = -1;
+        sequence.store(spareSequence, std::memory_order_relaxed);
+    }
+
+    segmentBytes = sizeof(SegmentHeader);
+    bytes.store(bytes.load(std::memory_order_relaxed) + sizeof(SegmentHeader), std::memory_order_relaxed);
+
+    // close the full segment and prepare the next one
+    syncer.Wake();
+}
+
+void RecordingSink::Retire()
+{
+    if (file < 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    retired.push_back(file);
+    current = -1;
+    file = -1;
+}
+
+void RecordingSink::Fail(const char* operation)
+{
+    fprintf(stderr, "recording stopped, %s of segment %u failed: %s\n", operation,
+            sequence.load(std::memory_order_relaxed), strerror(errno));
+    Retire();
+    recording.store(false, std::memory_order_relaxed);
+    pending.clear();
+    syncer.Wake();
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_RECORDINGSINK_H
+#define MASTER_RECORDINGSINK_H
+
+#include "RecordFormat.h"
+#include "Reading.h"
+#include "ServicePool.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct RecordingConfig
+{
+    /// directory the segments are created in, which must already exist
+    std::string directory;
+
+    /// the next segment is started once the current one would grow past this size
+    uint64_t maxSegmentBytes = 64 * 1024 * 1024;
+
+    /// longest time written chunks may sit in the page cache before they are synced to disk
+    std::chrono::milliseconds syncInterval{1000};
+};
+
+/**
+ * Records every reading to an append-only binary file and passes it on to another sink.
+ *
+ * Readings are kept as fixed-width RecordEntry items in a buffer that is reused between
+ * fragments, and Flush writes them as one chunk with a single system call before flushing the
+ * downstream sink. Segments are named outstation-<id>-<sequence>.rec and never overwritten. A
+ * crash can at worst leave a partial chunk at the end of the last segment, which
+ * RecordingReader detects and skips.
+ *
+ * Only the write happens on the caller's thread. Syncing, closing full segments and creating
+ * the next one run on a ServiceThread, which keeps a segment ready to switch to. If it is not
+ * ready yet, the current segment grows past maxSegmentBytes until it is.
+ *
+ * Append and Flush must be called from a single thread. If a write or sync fails, recording
+ * stops and readings are still forwarded.
+ */
+class RecordingSink final : public IReadingSink, private IService
+{
+public:
+    /**
+     * Creates the first segment
+     *
+     * @return the sink, or nullptr with a description in errors if the segment could not be created
+     */
+    static std::shared_ptr<RecordingSink> Open(std::shared_ptr<IReadingSink> downstream,
+                                               uint16_t outstation,
+                                               const RecordingConfig& config,
+                                               ServiceThread& syncer,
+                                               std::string& errors);
+
+    /// Syncs and closes the current segment
+    ~RecordingSink() override;
+
+    RecordingSink(const RecordingSink&) = delete;
+    RecordingSink& operator=(const RecordingSink&) = delete;
+
+    void Append(const Reading& reading) override;
+    void Flush() override;
+
+    /// @return readings written since the sink was opened
+    uint64_t Records() const
+    {
+        return records.load(std::memory_order_relaxed);
+    }
+
+    /// @return bytes written across all segments, headers included
+    uint64_t Bytes() const
+    {
+        return bytes.load(std::memory_order_relaxed);
+    }
+
+    /// @return sequence number of the segment currently written
+    uint32_t Sequence() const
+    {
+        return sequence.load(std::memory_order_relaxed);
+    }
+
+    /// @return false once a write has failed and recording stopped
+    bool Recording() const
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+private:
+    RecordingSink(std::shared_ptr<IReadingSink> downstream,
+                  uint16_t outstation,
+                  const RecordingConfig& config,
+                  ServiceThread& syncer);
+
+    Clock::time_point Service(Clock::time_point now) override;
+
+    /**
+     * Create a segment with the first free sequence number from next on, and write its header
+     *
+     * @return the file, or -1 with a description in errors
+     */
+    int OpenSegment(uint32_t& next, std::string& path, std::string& errors) const;
+
+    void WriteChunk();
+
+    /// Switch to the spare segment if there is one, the full one is closed in the background
+    void Rotate();
+
+    /// Hand the current segment to the syncer to be closed and stop writing
+    void Retire();
+    void Fail(const char* operation);
+
+    std::shared_ptr<IReadingSink> downstream;
+    const uint16_t outstation;
+    const RecordingConfig config;
+    ServiceThread& syncer;
+
+    // writer thread only
+    std::vector<RecordEntry> pending;
+    int file = -1;
+    uint64_t segmentBytes = 0;
+
+    // syncer thread only
+    uint32_t nextSequence = 0;
+    Clock::time_point lastSync;
+
+    // only the syncer closes a file, so it may sync one it read here without holding the mutex
+    std::mutex mutex;
+    int current = -1;
+    int spare = -1;
+    uint32_t spareSequence = 0;
+    std::string sparePath;
+    std::vector<int> retired;
+
+    // set by the writer after a write, cleared by the syncer before it syncs
+    std::atomic<bool> dirty{false};
+
+    // single writer, read by the console
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<bool> recording{false}; // also cleared by the syncer when a sync fails
+};
+
+#endif
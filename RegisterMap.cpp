@@ -0,0 +1,48 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "RegisterMap.h"
+
+RegisterMap::RegisterMap(const std::string& assetName, std::shared_ptr<StringPool> pool)
+    : strings(std::move(pool)), defaultAsset(strings->Intern(assetName))
+{
+}
+
+bool RegisterMap::Add(const MapEntry& entry, std::string& errors)
+{
+    auto& slots = tables[static_cast<size_t>(entry.type)];
+    if (static_cast<size_t>(entry.index) >= slots.size())
+    {
+        slots.resize(entry.index + 1);
+    }
+
+    auto& slot = slots[entry.index];
+    if (slot.IsMapped())
+    {
+        errors += entry.name + ": " + PointTypeName(entry.type) + " register " + std::to_string(entry.index)
+            + " already mapped to " + slot.name + "\n";
+        return false;
+    }
+
+    slot = entry.point;
+    slot.name = strings->Intern(entry.name);
+    slot.asset = entry.asset.empty() ? defaultAsset : strings->Intern(entry.asset);
+    ++count;
+    return true;
+}
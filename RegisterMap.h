@@ -0,0 +1,159 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_REGISTERMAP_H
+#define MASTER_REGISTERMAP_H
+
+#include "PointType.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * A single mapped point, compiled from one entry of the register map.
+ *
+ * The name and asset point into the StringPool of the RegisterMap and stay valid for its lifetime.
+ */
+struct PointConfig
+{
+    const char* name = nullptr;
+    const char* asset = nullptr;
+    double scale = 1.0;
+    double offset = 0.0;
+
+    // converted values are clamped to this range
+    double minimum = -std::numeric_limits<double>::infinity();
+    double maximum = std::numeric_limits<double>::infinity();
+
+    // report-by-exception settings, applied by ChangeFilter
+    bool filtered = false;
+    bool deadbandPercent = false; // deadband is a percentage of the last emitted value
+    double deadband = 0.0;        // on the scaled value
+    uint64_t maxIntervalMs = 0;   // emit at least this often, 0 for never
+
+    bool IsMapped() const
+    {
+        return name != nullptr;
+    }
+};
+
+/**
+ * One validated entry of the register map, as produced by RegisterMapLoader
+ */
+struct MapEntry
+{
+    std::string name;
+    std::string asset; // empty for the map's default asset
+    PointType type = PointType::Analog;
+    uint16_t index = 0;
+    bool anyOutstation = true; // no "out-station", applies to every master
+    uint16_t outstation = 0;
+    PointConfig point; // scale, offset and filter settings, name and asset are not set
+};
+
+/**
+ * Append-only storage for the names and assets that mapped points and readings point to.
+ *
+ * A reloaded map shares the pool of the map it replaces, so readings still queued downstream
+ * keep valid pointers after the old map is released. Equal strings are stored once, which bounds
+ * the growth across reloads. Interning happens on one thread at a time, while pointers handed out
+ * earlier may be read from any thread.
+ */
+class StringPool
+{
+public:
+    const char* Intern(const std::string& value)
+    {
+        // nodes never move, not even on rehash
+        return strings.insert(value).first->c_str();
+    }
+
+private:
+    std::unordered_set<std::string> strings;
+};
+
+/**
+ * The register map compiled into one dense table per point type, indexed by DNP3 point index.
+ *
+ * A lookup on the measurement path is a bounds check and a single array access.
+ * The map is filled once by RegisterMapLoader and is immutable afterwards. A new map is loaded
+ * to change it, see TestSOEHandler::Reload.
+ */
+class RegisterMap
+{
+public:
+    RegisterMap() = default;
+
+    /**
+     * @param defaultAsset asset name used for entries without an "assetName"
+     * @param strings pool to intern names and assets into, shared with earlier maps when reloading
+     */
+    explicit RegisterMap(const std::string& defaultAsset,
+                         std::shared_ptr<StringPool> strings = std::make_shared<StringPool>());
+
+    RegisterMap(RegisterMap&&) = default;
+    RegisterMap& operator=(RegisterMap&&) = default;
+
+    RegisterMap(const RegisterMap&) = delete;
+    RegisterMap& operator=(const RegisterMap&) = delete;
+
+    /**
+     * Add one entry to the table of its type.
+     *
+     * @param errors receives a line if the entry's point is already mapped
+     * @return false if the entry was rejected
+     */
+    bool Add(const MapEntry& entry, std::string& errors);
+
+    /// @return the mapped point for a type and index or nullptr if the point is not mapped
+    const PointConfig* Find(PointType type, uint16_t index) const
+    {
+        const auto& slots = tables[static_cast<size_t>(type)];
+        if (index < slots.size() && slots[index].IsMapped())
+        {
+            return &slots[index];
+        }
+        return nullptr;
+    }
+
+    /// @return the number of slots in the table of a type, one past the highest mapped index
+    size_t TableSize(PointType type) const
+    {
+        return tables[static_cast<size_t>(type)].size();
+    }
+
+    /// @return number of mapped points
+    size_t Count() const
+    {
+        return count;
+    }
+
+private:
+    std::array<std::vector<PointConfig>, POINT_TYPE_COUNT> tables;
+    std::shared_ptr<StringPool> strings = std::make_shared<StringPool>();
+    const char* defaultAsset = nullptr;
+    size_t count = 0;
+};
+
+#endif
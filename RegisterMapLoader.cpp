@@ -0,0 +1,578 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "RegisterMapLoader.h"
+
+#include "lib/include/rapidjson/error/en.h"
+#include "lib/include/rapidjson/reader.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+using namespace rapidjson;
+
+namespace
+{
+
+/**
+ * A scalar as it appeared in the JSON, before it is checked against what its key expects
+ */
+struct RawValue
+{
+    enum class Kind : uint8_t
+    {
+        Missing,
+        Number,
+        String,
+        Other
+    };
+
+    Kind kind = Kind::Missing;
+    bool integral = false;
+    double number = 0.0;
+    std::string text;
+
+    bool IsPresent() const
+    {
+        return kind != Kind::Missing;
+    }
+
+    bool IsInt() const
+    {
+        return kind == Kind::Number && integral;
+    }
+
+    bool IsNumber() const
+    {
+        return kind == Kind::Number;
+    }
+
+    bool IsString() const
+    {
+        return kind == Kind::String;
+    }
+};
+
+enum class EntryKey : uint8_t
+{
+    Name,
+    OutStation,
+    Register,
+    Type,
+    AssetName,
+    Scale,
+    Offset,
+    Minimum,
+    Maximum,
+    Deadband,
+    MaxInterval,
+    Count,
+    Unknown = Count
+};
+
+const char* const ENTRY_KEYS[] = {"name",  "out-station", "register", "type", "assetName",  "scale",
+                                  "offset", "min",         "max",      "deadband", "maxInterval"};
+
+EntryKey ParseKey(const char* key, SizeType length)
+{
+    for (size_t i = 0; i < static_cast<size_t>(EntryKey::Count); ++i)
+    {
+        if (strlen(ENTRY_KEYS[i]) == length && memcmp(ENTRY_KEYS[i], key, length) == 0)
+        {
+            return static_cast<EntryKey>(i);
+        }
+    }
+    return EntryKey::Unknown;
+}
+
+bool ParseFilter(const RawValue& deadband, const RawValue& maxInterval, PointConfig& point)
+{
+    if (deadband.IsPresent())
+    {
+        if (deadband.IsNumber())
+        {
+            point.deadband = deadband.number;
+        }
+        else if (deadband.IsString())
+        {
+            // "2.5%"
+            char* end = nullptr;
+            point.deadband = strtod(deadband.text.c_str(), &end);
+            if (end == deadband.text.c_str() || strcmp(end, "%") != 0)
+            {
+                return false;
+            }
+            point.deadbandPercent = true;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (!(point.deadband >= 0.0) || std::isinf(point.deadband))
+        {
+            return false;
+        }
+        point.filtered = true;
+    }
+
+    if (maxInterval.IsPresent())
+    {
+        if (!maxInterval.IsNumber() || !(maxInterval.number > 0.0) || maxInterval.number > 1e9)
+        {
+            return false;
+        }
+        point.maxIntervalMs = static_cast<uint64_t>(maxInterval.number * 1000.0);
+        point.filtered = true;
+    }
+
+    return true;
+}
+
+/**
+ * SAX handler that walks { "values" : [ {entry}, ... ] } and validates each entry as it closes
+ */
+class MapReader : public BaseReaderHandler<UTF8<>, MapReader>
+{
+public:
+    MapReader(std::unordered_map<uint16_t, RegisterMap*>& maps, std::string& errors, MapLoadStats& stats)
+        : maps(maps), errors(errors), stats(stats)
+    {
+    }
+
+    bool Null()
+    {
+        return Other();
+    }
+
+    bool Bool(bool)
+    {
+        return Other();
+    }
+
+    bool Int(int value)
+    {
+        return Number(value, true);
+    }
+
+    bool Uint(unsigned value)
+    {
+        return Number(value, true);
+    }
+
+    bool Int64(int64_t value)
+    {
+        return Number(static_cast<double>(value), true);
+    }
+
+    bool Uint64(uint64_t value)
+    {
+        return Number(static_cast<double>(value), true);
+    }
+
+    bool Double(double value)
+    {
+        return Number(value, false);
+    }
+
+    bool String(const char* value, SizeType length, bool)
+    {
+        auto field = Field();
+        if (field)
+        {
+            field->kind = RawValue::Kind::String;
+            field->text.assign(value, length);
+        }
+        return Scalar();
+    }
+
+    bool Key(const char* key, SizeType length, bool)
+    {
+        if (depth == 1)
+        {
+            inValuesKey = (length == 6 && memcmp(key, "values", 6) == 0);
+        }
+        else if (depth == 3 && inValues)
+        {
+            currentKey = ParseKey(key, length);
+        }
+        return true;
+    }
+
+    bool StartObject()
+    {
+        ++depth;
+        if (depth == 1)
+        {
+            return true;
+        }
+        if (depth == 3 && inValues)
+        {
+            for (auto& value : values)
+            {
+                value = RawValue();
+            }
+            currentKey = EntryKey::Unknown;
+            return true;
+        }
+        return Nested();
+    }
+
+    bool EndObject(SizeType)
+    {
+        if (depth == 3 && inValues)
+        {
+            Finish();
+        }
+        --depth;
+        return true;
+    }
+
+    bool StartArray()
+    {
+        ++depth;
+        if (depth == 2 && inValuesKey)
+        {
+            inValues = true;
+            sawValues = true;
+            return true;
+        }
+        if (depth == 3 && inValues)
+        {
+            ++stats.entries;
+            Reject("register map entry is not an object");
+        }
+        return Nested();
+    }
+
+    bool EndArray(SizeType)
+    {
+        if (depth == 2)
+        {
+            inValues = false;
+        }
+        --depth;
+        return true;
+    }
+
+    bool SawValues() const
+    {
+        return sawValues;
+    }
+
+private:
+    bool Number(double value, bool integral)
+    {
+        auto field = Field();
+        if (field)
+        {
+            field->kind = RawValue::Kind::Number;
+            field->number = value;
+            field->integral = integral;
+        }
+        return Scalar();
+    }
+
+    bool Other()
+    {
+        auto field = Field();
+        if (field)
+        {
+            field->kind = RawValue::Kind::Other;
+        }
+        return Scalar();
+    }
+
+    /// @return the field a scalar at the current position belongs to, if it is a known entry key
+    RawValue* Field()
+    {
+        if (depth == 3 && inValues && currentKey != EntryKey::Unknown)
+        {
+            return &values[static_cast<size_t>(currentKey)];
+        }
+        return nullptr;
+    }
+
+    bool Scalar()
+    {
+        if (depth == 0)
+        {
+            return Fail("register map is not an object");
+        }
+        if (depth == 1 && inValuesKey)
+        {
+            return Fail("register map \"values\" is not an array");
+        }
+        if (depth == 2 && inValues)
+        {
+            ++stats.entries;
+            Reject("register map entry is not an object");
+        }
+        return true;
+    }
+
+    /// An object or array that is not part of the expected layout
+    bool Nested()
+    {
+        if (depth == 1)
+        {
+            return Fail("register map is not an object");
+        }
+        if (depth == 2 && inValuesKey)
+        {
+            return Fail("register map \"values\" is not an array");
+        }
+        if (depth == 4 && inValues && currentKey != EntryKey::Unknown)
+        {
+            // an object or array where an entry expects a scalar
+            values[static_cast<size_t>(currentKey)].kind = RawValue::Kind::Other;
+        }
+        return true;
+    }
+
+    bool Fail(const char* message)
+    {
+        errors += message;
+        errors += "\n";
+        return false;
+    }
+
+    void Reject(const std::string& message)
+    {
+        ++stats.rejected;
+        errors += message + "\n";
+    }
+
+    const RawValue& Get(EntryKey key) const
+    {
+        return values[static_cast<size_t>(key)];
+    }
+
+    void Finish()
+    {
+        ++stats.entries;
+
+        const auto& name = Get(EntryKey::Name);
+        if (!name.IsString())
+        {
+            Reject("register map entry without a name");
+            return;
+        }
+
+        MapEntry entry;
+        entry.name = name.text;
+
+        const auto& outstation = Get(EntryKey::OutStation);
+        if (outstation.IsPresent())
+        {
+            if (!outstation.IsInt() || outstation.number < 0 || outstation.number > std::numeric_limits<uint16_t>::max()
+                || maps.find(static_cast<uint16_t>(outstation.number)) == maps.end())
+            {
+                Reject(entry.name + ": \"out-station\" is not the id of a configured outstation");
+                return;
+            }
+            entry.anyOutstation = false;
+            entry.outstation = static_cast<uint16_t>(outstation.number);
+        }
+
+        const auto& index = Get(EntryKey::Register);
+        if (!index.IsInt())
+        {
+            Reject(entry.name + ": missing or non-integer \"register\"");
+            return;
+        }
+
+        const auto& type = Get(EntryKey::Type);
+        if (type.IsPresent() && !(type.IsString() && ParsePointType(type.text.c_str(), entry.type)))
+        {
+            Reject(entry.name + ": unknown \"type\"");
+            return;
+        }
+
+        if (index.number < 0 || index.number > std::numeric_limits<uint16_t>::max())
+        {
+            Reject(entry.name + ": register " + std::to_string(static_cast<int64_t>(index.number))
+                   + " is outside the DNP3 index range");
+            return;
+        }
+        entry.index = static_cast<uint16_t>(index.number);
+
+        if (!ParseFilter(Get(EntryKey::Deadband), Get(EntryKey::MaxInterval), entry.point))
+        {
+            Reject(entry.name + ": \"deadband\" must be a non-negative number or percentage"
+                                " and \"maxInterval\" a positive number of seconds");
+            return;
+        }
+
+        const auto& asset = Get(EntryKey::AssetName);
+        if (asset.IsString())
+        {
+            entry.asset = asset.text;
+        }
+
+        const auto& scale = Get(EntryKey::Scale);
+        const auto& offset = Get(EntryKey::Offset);
+        if ((scale.IsPresent() && !scale.IsNumber()) || (offset.IsPresent() && !offset.IsNumber()))
+        {
+            Reject(entry.name + ": \"scale\" and \"offset\" must be numbers");
+            return;
+        }
+        entry.point.scale = scale.IsNumber() ? scale.number : 1.0;
+        entry.point.offset = offset.IsNumber() ? offset.number : 0.0;
+
+        const auto& minimum = Get(EntryKey::Minimum);
+        const auto& maximum = Get(EntryKey::Maximum);
+        if ((minimum.IsPresent() && !minimum.IsNumber()) || (maximum.IsPresent() && !maximum.IsNumber()))
+        {
+            Reject(entry.name + ": \"min\" and \"max\" must be numbers");
+            return;
+        }
+        if (minimum.IsNumber())
+        {
+            entry.point.minimum = minimum.number;
+        }
+        if (maximum.IsNumber())
+        {
+            entry.point.maximum = maximum.number;
+        }
+        if (!(entry.point.minimum <= entry.point.maximum))
+        {
+            Reject(entry.name + ": \"min\" is above \"max\"");
+            return;
+        }
+
+        // an entry for every outstation counts once, however many of their maps turned it down
+        bool added = true;
+        if (entry.anyOutstation)
+        {
+            for (auto& map : maps)
+            {
+                added = map.second->Add(entry, errors) && added;
+            }
+        }
+        else
+        {
+            added = maps[entry.outstation]->Add(entry, errors);
+        }
+        if (!added)
+        {
+            ++stats.rejected;
+        }
+    }
+
+    std::unordered_map<uint16_t, RegisterMap*>& maps;
+    std::string& errors;
+    MapLoadStats& stats;
+
+    int depth = 0;
+    bool inValuesKey = false;
+    bool inValues = false;
+    bool sawValues = false;
+    EntryKey currentKey = EntryKey::Unknown;
+    RawValue values[static_cast<size_t>(EntryKey::Count)];
+};
+
+} // namespace
+
+bool RegisterMapLoader::IsInline(const std::string& source)
+{
+    for (const auto c : source)
+    {
+        if (!isspace(static_cast<unsigned char>(c)))
+        {
+            return c == '{' || c == '[';
+        }
+    }
+    return false;
+}
+
+std::vector<RegisterMap> RegisterMapLoader::Load(const std::string& source,
+                                                 const std::string& defaultAsset,
+                                                 const std::vector<uint16_t>& outstations,
+                                                 std::string& errors,
+                                                 MapLoadStats* stats,
+                                                 std::shared_ptr<StringPool> strings)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // the in-situ parse needs a writable, terminated copy either way
+    std::vector<char> buffer;
+    if (IsInline(source))
+    {
+        buffer.assign(source.begin(), source.end());
+    }
+    else
+    {
+        std::ifstream file(source, std::ios::binary);
+        if (!file)
+        {
+            errors += "register map: cannot open " + source + "\n";
+            return {};
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    buffer.push_back('\0');
+
+    std::vector<RegisterMap> maps;
+    maps.reserve(outstations.size());
+    std::unordered_map<uint16_t, RegisterMap*> byId;
+    if (!strings)
+    {
+        strings = std::make_shared<StringPool>();
+    }
+    for (size_t i = 0; i < outstations.size(); ++i)
+    {
+        maps.emplace_back(defaultAsset, strings);
+        byId[outstations[i]] = &maps.back();
+    }
+
+    MapLoadStats local;
+    auto& counts = stats ? *stats : local;
+    counts = MapLoadStats();
+
+    MapReader handler(byId, errors, counts);
+    InsituStringStream stream(buffer.data());
+    Reader reader;
+
+    const auto result = reader.Parse<kParseInsituFlag>(stream, handler);
+    if (result.IsError())
+    {
+        // a structural problem has already been reported by the handler
+        if (result.Code() != kParseErrorTermination)
+        {
+            errors += std::string("register map: ") + GetParseError_En(result.Code()) + " at offset "
+                + std::to_string(result.Offset()) + "\n";
+        }
+        return {};
+    }
+
+    if (!handler.SawValues())
+    {
+        errors += "register map has no \"values\" array\n";
+        return {};
+    }
+
+    counts.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    return maps;
+}
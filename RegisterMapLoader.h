@@ -0,0 +1,75 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_REGISTERMAPLOADER_H
+#define MASTER_REGISTERMAPLOADER_H
+
+#include "RegisterMap.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct MapLoadStats
+{
+    size_t entries = 0;  // entries seen in "values"
+    size_t rejected = 0; // entries reported in the errors
+    std::chrono::microseconds elapsed{0};
+};
+
+/**
+ * Compiles a register map for every master in a single SAX pass.
+ *
+ * The JSON is parsed in place with RapidJSON's Reader, without building a DOM. Each entry is
+ * validated as soon as its object closes and added straight to the RegisterMap of its outstation,
+ * or to all of them if it has no "out-station".
+ *
+ * A register map is an object whose "values" array holds the entries:
+ *
+ *   { "values" : [ { "name" : "temperature", "register" : 102, "scale" : 0.1, ... }, ... ] }
+ *
+ * Entry keys are "name" and "register" (required), "type", "out-station", "assetName", "scale",
+ * "offset", "min", "max", "deadband" and "maxInterval". Unknown keys are ignored.
+ */
+class RegisterMapLoader
+{
+public:
+    /**
+     * @param source the register map JSON itself, or the path of a file holding it
+     * @param defaultAsset asset name used for entries without an "assetName"
+     * @param outstations ids of the masters to compile a map for
+     * @param errors receives one line per rejected entry, or a parse or file error
+     * @param stats optionally receives entry counts and the load time
+     * @param strings pool the maps intern their strings into, pass the current one when reloading
+     * @return one map per outstation id, in the same order, empty if the map could not be read
+     */
+    static std::vector<RegisterMap> Load(const std::string& source,
+                                         const std::string& defaultAsset,
+                                         const std::vector<uint16_t>& outstations,
+                                         std::string& errors,
+                                         MapLoadStats* stats = nullptr,
+                                         std::shared_ptr<StringPool> strings = nullptr);
+
+    /// @return true if the source looks like inline JSON rather than a file path
+    static bool IsInline(const std::string& source);
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ServicePool.h"
+
+#include <algorithm>
+
+ServiceThread::ServiceThread() : worker([this]() { Run(); }) {}
+
+ServiceThread::~ServiceThread()
+{
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        signal.notify_one();
+    }
+    worker.join();
+}
+
+void ServiceThread::Add(IService* service)
+{
+    {
+        std::lock_guard<std::mutex> lock(servicesMutex);
+        services.push_back(service);
+    }
+    Wake();
+}
+
+void ServiceThread::Remove(IService* service)
+{
+    std::lock_guard<std::mutex> lock(servicesMutex);
+    services.erase(std::remove(services.begin(), services.end(), service), services.end());
+}
+
+void ServiceThread::Wake()
+{
+    // pairs with Run: either this sees the thread parked, or the thread sees pending before it waits
+    pending.store(true);
+    if (parked.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        signal.notify_one();
+    }
+}
+
+void ServiceThread::Run()
+{
+    while (!stopping)
+    {
+        pending.store(false);
+
+        auto due = IService::Clock::time_point::max();
+        {
+            std::lock_guard<std::mutex> lock(servicesMutex);
+            const auto now = IService::Clock::now();
+            for (auto service : services)
+            {
+                due = std::min(due, service->Service(now));
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        parked.store(true);
+        auto ready = [this]() { return pending.load() || stopping.load(); };
+        if (due == IService::Clock::time_point::max())
+        {
+            signal.wait(lock, ready);
+        }
+        else
+        {
+            signal.wait_until(lock, due, ready);
+        }
+        parked.store(false);
+    }
+}
+
+ServicePool::ServicePool(size_t count)
+{
+    for (size_t i = 0; i < std::max<size_t>(count, 1); ++i)
+    {
+        threads.emplace_back(new ServiceThread());
+    }
+}
+
+ServiceThread& ServicePool::Assign()
+{
+    auto& thread = *threads[next];
+    next = (next + 1) % threads.size();
+    return thread;
+}
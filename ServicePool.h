@@ -0,0 +1,107 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_SERVICEPOOL_H
+#define MASTER_SERVICEPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Background work that runs on a ServiceThread, such as draining a reading queue or sending
+ * queued commands
+ */
+class IService
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~IService() = default;
+
+    /**
+     * Do whatever work is ready, without blocking
+     *
+     * @return when to be called again if nothing calls Wake before, Clock::time_point::max() for never
+     */
+    virtual Clock::time_point Service(Clock::time_point now) = 0;
+};
+
+/**
+ * One thread shared by many services.
+ *
+ * It services every attached service in turn and then parks until the earliest time one of them
+ * asked for or until Wake. Wake costs an atomic store and load while the thread is busy, and only
+ * takes the mutex to notify a parked thread.
+ */
+class ServiceThread
+{
+public:
+    ServiceThread();
+
+    /// Stops the thread, services still attached are not called again
+    ~ServiceThread();
+
+    ServiceThread(const ServiceThread&) = delete;
+    ServiceThread& operator=(const ServiceThread&) = delete;
+
+    void Add(IService* service);
+
+    /// Detach a service, returns once no call to it is running
+    void Remove(IService* service);
+
+    /// Have every service called again soon, from any thread
+    void Wake();
+
+private:
+    void Run();
+
+    std::mutex servicesMutex; // held for a whole pass over the services
+    std::vector<IService*> services;
+
+    std::atomic<bool> pending{false};
+    std::atomic<bool> parked{false};
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable signal;
+
+    std::thread worker;
+};
+
+/**
+ * A fixed number of ServiceThreads that services are spread over
+ */
+class ServicePool
+{
+public:
+    explicit ServicePool(size_t threads);
+
+    /// @return the thread to attach the next service to, round robin
+    ServiceThread& Assign();
+
+private:
+    std::vector<std::unique_ptr<ServiceThread>> threads;
+    size_t next = 0;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MASTER_TESTSOEHANDLER_H
+#define MASTER_TESTSOEHANDLER_H
+
+#include "ChangeFilter.h"
+#include "MeasurementTraits.h"
+#include "Metrics.h"
+#include "Reading.h"
+#include "ReadingBatch.h"
+#include "RegisterMap.h"
+
+#include <opendnp3/master/ISOEHandler.h>
+
+#include <atomic>
+#include <memory>
+
+/**
+ * Maps, scales and filters the measurements of one master and hands them to a reading sink.
+ *
+ * Shared by the master-demo program and the offline benchmark.
+ *
+ * The register map is an immutable snapshot that Reload replaces from any thread. The stack
+ * thread checks a generation counter once per fragment and only touches the shared pointer
+ * when it has changed, so the measurement path takes no lock.
+ */
+class TestSOEHandler : public opendnp3::ISOEHandler
+{
+    public: 
+        TestSOEHandler(std::shared_ptr<const RegisterMap> map, std::shared_ptr<IReadingSink> sink, std::shared_ptr<MasterMetrics> metrics)
+            : registers(map), filter(*registers), sink(std::move(sink)), metrics(std::move(metrics)), published(std::move(map)) {}
+
+        /// Publish a new map, used from the start of the next fragment. Deadband references start over.
+        void Reload(std::shared_ptr<const RegisterMap> map) {
+            std::atomic_store(&published, std::move(map));
+            generation.fetch_add(1, std::memory_order_release);
+        }
+
+        /// @return number of maps published by Reload
+        uint64_t Reloads() const {
+            return generation.load(std::memory_order_relaxed);
+        }
+
+        const ChangeFilter& Filter() const {
+            return filter;
+        }
+
+        /// @return running count of points received in solicited responses, mapped or not
+        uint64_t PointsReceived() const {
+            return pointsReceived.load(std::memory_order_relaxed);
+        }
+
+    private: 
+
+        virtual void BeginFragment(const opendnp3::ResponseInfo& info){
+            // a reloaded map takes effect between fragments, never halfway through one
+            const auto latest = generation.load(std::memory_order_acquire);
+            if (latest != activeGeneration) {
+                activeGeneration = latest;
+                registers = std::atomic_load(&published);
+                filter.Reset(*registers);
+            }
+
+            solicited = !info.unsolicited;
+            fragmentStart = SteadyNanos();
+            fragmentTime = fragmentStart / 1000000;
+            wallTime = WallMillis();
+            fragmentPoints = 0;
+        };
+
+        // one write per fragment, however many points it carried
+        virtual void EndFragment(const opendnp3::ResponseInfo& info){
+            sink->Flush();
+
+            metrics->fragmentNs.Record(SteadyNanos() - fragmentStart);
+            metrics->pointsPerFragment.Record(fragmentPoints);
+        };
+
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::Binary>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::DoubleBitBinary>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::Analog>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::Counter>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::FrozenCounter>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::BinaryOutputStatus>>& values) {
+            Emit(values);
+        };
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::AnalogOutputStatus>>& values) {
+            Emit(values);
+        };
+
+        // not scalar measurements, nothing to map
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::OctetString>>& values) {};
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::TimeAndInterval>>& values) {};
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::BinaryCommandEvent>>& values) {};
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::Indexed<opendnp3::AnalogCommandEvent>>& values) {};    
+        virtual void Process(const opendnp3::HeaderInfo& info,
+                             const opendnp3::ICollection<opendnp3::DNPTime>& values) {};
+
+        // the one mapping, scaling and emitting path, resolved per type at compile time.
+        // Mapped points are gathered into columns and converted as one batch before filtering.
+        template<class T> void Emit(const opendnp3::ICollection<opendnp3::Indexed<T>>& values) {
+            using Traits = MeasurementTraits<T>;
+
+            const auto start = SteadyNanos();
+            fragmentPoints += values.Count();
+
+            // events seen by the adaptive scan, single writer
+            if (solicited) {
+                pointsReceived.store(pointsReceived.load(std::memory_order_relaxed) + values.Count(),
+                                     std::memory_order_relaxed);
+            }
+
+            batch.Clear();
+            auto gather = [this](const opendnp3::Indexed<T>& pair) {
+                const auto point = registers->Find(Traits::pointType, pair.index);
+                const auto timestamp = Traits::Timestamp(pair.value);
+                if (timestamp != 0) {
+                    metrics->deviceLagMs.Record(wallTime > timestamp ? wallTime - timestamp : 0);
+                }
+
+                if (point) {
+                    // a point sent without a time is stamped with the fragment's arrival instead of 1970
+                    batch.Add(*point, pair.index, Traits::Value(pair.value), Traits::Flags(pair.value),
+                              Traits::HasTime(pair.value) ? timestamp : wallTime);
+                }
+            };
+
+            values.ForeachItem(gather);
+            batch.Convert(Traits::overrange);
+
+            for (size_t i = 0; i < batch.Size(); ++i) {
+                const auto& point = *batch.points[i];
+                if (!filter.Accept(point, Traits::pointType, batch.indices[i], batch.values[i], batch.flags[i], fragmentTime)) {
+                    continue;
+                }
+
+                Reading reading;
+                reading.timestamp = batch.timestamps[i];
+                reading.received = fragmentStart;
+                reading.name = point.name;
+                reading.asset = point.asset;
+                reading.type = Traits::pointType;
+                reading.index = batch.indices[i];
+                reading.flags = batch.flags[i];
+                reading.raw = batch.raw[i];
+                reading.value = batch.values[i];
+                sink->Append(reading);
+            }
+
+            metrics->processNs[static_cast<size_t>(Traits::pointType)].Record(SteadyNanos() - start);
+        }
+
+        std::shared_ptr<const RegisterMap> registers; // the snapshot in use, stack thread only
+        ChangeFilter filter;
+        ReadingBatch batch; // reused by every header
+        std::shared_ptr<IReadingSink> sink;
+        std::shared_ptr<MasterMetrics> metrics;
+        uint64_t fragmentStart = 0; // steady clock, nanoseconds
+        uint64_t fragmentTime = 0;  // steady clock, milliseconds
+        uint64_t wallTime = 0;      // wall clock, milliseconds since epoch
+        size_t fragmentPoints = 0;
+        bool solicited = true;
+        std::atomic<uint64_t> pointsReceived{0};
+
+        // written by Reload
+        std::shared_ptr<const RegisterMap> published;
+        std::atomic<uint64_t> generation{0};
+        uint64_t activeGeneration = 0;
+};
+
+#endif
@@ -0,0 +1,487 @@
+/*
+ * Copyright 2013-2020 Automatak, LLC
+ *
+ * Licensed to Green Energy Corp (www.greenenergycorp.com) and Automatak
+ * LLC (www.automatak.com) under one or more contributor license agreements.
+ * See the NOTICE file distributed with this work for additional information
+ * regarding copyright ownership. Green Energy Corp and Automatak LLC license
+ * this file to you under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Feeds synthetic fragments through TestSOEHandler without an outstation or network and
+// reports throughput and allocations for each measurement type. With --replay, feeds the
+// fragments of a recorded segment instead, through the register map given with --register-map
+// as a file or inline JSON, or through the synthetic one if --map is given instead.
+//
+// usage: master-bench [--points N] [--fragment N] [--map N] [--sink null|json|queued]
+//                     [--replay FILE [--register-map FILE|JSON]]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "JsonReadingSink.h"
+#include "QueuedReadingSink.h"
+#include "RecordingReader.h"
+#include "RegisterMapLoader.h"
+#include "ServicePool.h"
+#include "TestSOEHandler.h"
+
+using namespace std;
+using namespace opendnp3;
+
+// every heap allocation in the process, to catch allocations on the measurement path
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto memory = malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+struct BenchConfig
+{
+    size_t points = 1000000;  // per measurement type
+    size_t fragment = 1000;   // points per fragment
+    size_t mapSize = 1000;    // mapped indices per type, points cycle over [0, mapSize)
+    string sink = "null";
+    string replay;            // recorded segment to feed instead of synthetic points
+    string registerMap;       // map to replay through, the same source master-demo takes
+    bool syntheticMap = false; // --map given
+};
+
+/**
+ * Counts readings and discards them, so the run measures the handler alone
+ */
+class NullSink final : public IReadingSink
+{
+public:
+    void Append(const Reading&) override
+    {
+        ++count;
+    }
+
+    void Flush() override {}
+
+    size_t count = 0;
+};
+
+/**
+ * A prebuilt header of measurements, handed to the handler the way the stack would
+ */
+template<class T> class VectorCollection final : public ICollection<Indexed<T>>
+{
+public:
+    size_t Count() const override
+    {
+        return items.size();
+    }
+
+    void Foreach(IVisitor<Indexed<T>>& visitor) const override
+    {
+        for (const auto& item : items)
+        {
+            visitor.OnValue(item);
+        }
+    }
+
+    std::vector<Indexed<T>> items;
+};
+
+template<class T> T MakeMeasurement(uint32_t seed, DNPTime time);
+
+template<> Binary MakeMeasurement<Binary>(uint32_t seed, DNPTime time)
+{
+    return Binary(seed & 1, Flags(0x01), time);
+}
+
+template<> DoubleBitBinary MakeMeasurement<DoubleBitBinary>(uint32_t seed, DNPTime time)
+{
+    return DoubleBitBinary((seed & 1) ? DoubleBit::DETERMINED_ON : DoubleBit::DETERMINED_OFF, Flags(0x01), time);
+}
+
+template<> Analog MakeMeasurement<Analog>(uint32_t seed, DNPTime time)
+{
+    return Analog(seed * 0.5, Flags(0x01), time);
+}
+
+template<> Counter MakeMeasurement<Counter>(uint32_t seed, DNPTime time)
+{
+    return Counter(seed, Flags(0x01), time);
+}
+
+template<> FrozenCounter MakeMeasurement<FrozenCounter>(uint32_t seed, DNPTime time)
+{
+    return FrozenCounter(seed, Flags(0x01), time);
+}
+
+template<> BinaryOutputStatus MakeMeasurement<BinaryOutputStatus>(uint32_t seed, DNPTime time)
+{
+    return BinaryOutputStatus(seed & 1, Flags(0x01), time);
+}
+
+template<> AnalogOutputStatus MakeMeasurement<AnalogOutputStatus>(uint32_t seed, DNPTime time)
+{
+    return AnalogOutputStatus(seed * 0.25, Flags(0x01), time);
+}
+
+template<class T> T FromRecord(const RecordEntry& record);
+
+template<> Binary FromRecord<Binary>(const RecordEntry& record)
+{
+    return Binary(record.raw != 0, Flags(record.flags), DNPTime(record.timestamp));
+}
+
+template<> DoubleBitBinary FromRecord<DoubleBitBinary>(const RecordEntry& record)
+{
+    return DoubleBitBinary(static_cast<DoubleBit>(static_cast<uint8_t>(record.raw)), Flags(record.flags),
+                           DNPTime(record.timestamp));
+}
+
+template<> Analog FromRecord<Analog>(const RecordEntry& record)
+{
+    return Analog(record.raw, Flags(record.flags), DNPTime(record.timestamp));
+}
+
+template<> Counter FromRecord<Counter>(const RecordEntry& record)
+{
+    return Counter(static_cast<uint32_t>(record.raw), Flags(record.flags), DNPTime(record.timestamp));
+}
+
+template<> FrozenCounter FromRecord<FrozenCounter>(const RecordEntry& record)
+{
+    return FrozenCounter(static_cast<uint32_t>(record.raw), Flags(record.flags), DNPTime(record.timestamp));
+}
+
+template<> BinaryOutputStatus FromRecord<BinaryOutputStatus>(const RecordEntry& record)
+{
+    return BinaryOutputStatus(record.raw != 0, Flags(record.flags), DNPTime(record.timestamp));
+}
+
+template<> AnalogOutputStatus FromRecord<AnalogOutputStatus>(const RecordEntry& record)
+{
+    return AnalogOutputStatus(record.raw, Flags(record.flags), DNPTime(record.timestamp));
+}
+
+/// A register map with mapSize points of every type at indices 0 to mapSize - 1
+static string MakeMap(size_t mapSize)
+{
+    string json = "{\"values\":[";
+    for (size_t i = 0; i < POINT_TYPE_COUNT; ++i)
+    {
+        const string type = PointTypeName(static_cast<PointType>(i));
+        for (size_t index = 0; index < mapSize; ++index)
+        {
+            if (i != 0 || index != 0)
+            {
+                json += ",";
+            }
+            json += "{\"name\":\"" + type + "-" + to_string(index) + "\",\"type\":\"" + type
+                + "\",\"register\":" + to_string(index) + ",\"scale\":0.1,\"offset\":1.0}";
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+static shared_ptr<IReadingSink> MakeSink(const string& name)
+{
+    // formatting is measured, the write itself is not
+    static FILE* const discard = fopen("/dev/null", "w");
+
+    if (name == "json")
+    {
+        return make_shared<JsonReadingSink>(discard);
+    }
+    if (name == "queued")
+    {
+        QueueConfig config;
+        config.capacity = 65536;
+        config.policy = OverflowPolicy::Block;
+        static ServicePool consumers(1);
+        return make_shared<QueuedReadingSink>(make_shared<JsonReadingSink>(discard), config, consumers.Assign());
+    }
+    return make_shared<NullSink>();
+}
+
+template<class T> void Run(const BenchConfig& config)
+{
+    // the handler takes ownership of its map, so each type builds its own
+    string errors;
+    auto maps = RegisterMapLoader::Load(MakeMap(config.mapSize), "bench", {1}, errors);
+    TestSOEHandler handler(make_shared<const RegisterMap>(std::move(maps.front())), MakeSink(config.sink),
+                           make_shared<MasterMetrics>());
+    ISOEHandler& stack = handler;
+
+    // prebuild one fragment's worth of points so that generation is not measured
+    VectorCollection<T> collection;
+    const auto now = DNPTime(WallMillis());
+    for (size_t i = 0; i < config.fragment; ++i)
+    {
+        collection.items.emplace_back(MakeMeasurement<T>(static_cast<uint32_t>(i), now),
+                                      static_cast<uint16_t>(i % config.mapSize));
+    }
+
+    const auto fragments = (config.points + config.fragment - 1) / config.fragment;
+    const ResponseInfo info(false, true, true);
+    const HeaderInfo header;
+
+    auto feed = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i)
+        {
+            stack.BeginFragment(info);
+            stack.Process(header, collection);
+            stack.EndFragment(info);
+        }
+    };
+
+    // let buffers grow to their steady state size first
+    feed(10);
+
+    const auto allocationsBefore = allocations.load();
+    const auto start = chrono::steady_clock::now();
+    feed(fragments);
+    const auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const auto allocated = allocations.load() - allocationsBefore;
+
+    const auto total = static_cast<double>(fragments * config.fragment);
+    printf("%-20s %12.0f points/s %9.1f ns/point %9.2f allocs/fragment\n",
+           PointTypeName(MeasurementTraits<T>::pointType), total / elapsed, elapsed * 1e9 / total,
+           static_cast<double>(allocated) / fragments);
+}
+
+// one reusable header per measurement type
+using ReplayCollections = tuple<VectorCollection<Binary>,
+                                VectorCollection<DoubleBitBinary>,
+                                VectorCollection<Analog>,
+                                VectorCollection<Counter>,
+                                VectorCollection<FrozenCounter>,
+                                VectorCollection<BinaryOutputStatus>,
+                                VectorCollection<AnalogOutputStatus>>;
+
+template<class T>
+void ReplayHeader(ISOEHandler& stack, ReplayCollections& collections, const RecordEntry* records, size_t count)
+{
+    auto& collection = get<VectorCollection<T>>(collections);
+    collection.items.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        collection.items.emplace_back(FromRecord<T>(records[i]), records[i].index);
+    }
+    stack.Process(HeaderInfo(), collection);
+}
+
+static void ReplayRun(ISOEHandler& stack, ReplayCollections& collections, const RecordEntry* records, size_t count)
+{
+    switch (static_cast<PointType>(records->type))
+    {
+    case PointType::Binary:
+        ReplayHeader<Binary>(stack, collections, records, count);
+        break;
+    case PointType::DoubleBitBinary:
+        ReplayHeader<DoubleBitBinary>(stack, collections, records, count);
+        break;
+    case PointType::Analog:
+        ReplayHeader<Analog>(stack, collections, records, count);
+        break;
+    case PointType::Counter:
+        ReplayHeader<Counter>(stack, collections, records, count);
+        break;
+    case PointType::FrozenCounter:
+        ReplayHeader<FrozenCounter>(stack, collections, records, count);
+        break;
+    case PointType::BinaryOutputStatus:
+        ReplayHeader<BinaryOutputStatus>(stack, collections, records, count);
+        break;
+    case PointType::AnalogOutputStatus:
+        ReplayHeader<AnalogOutputStatus>(stack, collections, records, count);
+        break;
+    }
+}
+
+/// Scans a recorded segment in place, then feeds each chunk to the handler as one fragment
+static int Replay(const BenchConfig& config)
+{
+    RecordingReader reader;
+    string errors;
+    if (!reader.Open(config.replay, errors))
+    {
+        fputs(errors.c_str(), stderr);
+        return 1;
+    }
+
+    printf("%s: outstation %u, segment %u, %zu records in %zu chunks%s\n", config.replay.c_str(),
+           reader.Header().outstation, reader.Header().sequence, reader.Records(), reader.Chunks(),
+           reader.Truncated() ? ", partial chunk at end ignored" : "");
+
+    // a segment that was only created, like the spare one left by a crash, has nothing to measure
+    if (reader.Chunks() == 0 || reader.Records() == 0)
+    {
+        fprintf(stderr, "%s: no complete chunks\n", config.replay.c_str());
+        return 1;
+    }
+
+    // a pass over the mapped records alone, the floor for any analysis of a recording
+    double sum = 0.0;
+    auto start = chrono::steady_clock::now();
+    reader.ForeachChunk([&sum](const ChunkHeader& chunk, const RecordEntry* records) {
+        for (uint32_t i = 0; i < chunk.count; ++i)
+        {
+            sum += records[i].value;
+        }
+    });
+    auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%-20s %12.0f records/s (sum %g)\n", "scan", reader.Records() / elapsed, sum);
+
+    // the recording's own map decides which points are kept and how they are scaled, the
+    // synthetic one only stands in when --map asks for it
+    const auto mapSource = config.registerMap.empty() ? MakeMap(config.mapSize) : config.registerMap;
+    string mapErrors;
+    MapLoadStats mapStats;
+    auto maps = RegisterMapLoader::Load(mapSource, "bench", {reader.Header().outstation}, mapErrors, &mapStats);
+    if (maps.empty())
+    {
+        fputs(mapErrors.c_str(), stderr);
+        return 1;
+    }
+    fputs(mapErrors.c_str(), stderr);
+    printf("register map: %zu entries, %zu rejected, %zu mapped for outstation %u\n", mapStats.entries,
+           mapStats.rejected, maps.front().Count(), reader.Header().outstation);
+    TestSOEHandler handler(make_shared<const RegisterMap>(std::move(maps.front())), MakeSink(config.sink),
+                           make_shared<MasterMetrics>());
+    ISOEHandler& stack = handler;
+
+    ReplayCollections collections;
+    const ResponseInfo info(false, true, true);
+
+    // one header per run of records of the same type, in recorded order
+    const auto allocationsBefore = allocations.load();
+    start = chrono::steady_clock::now();
+    reader.ForeachChunk([&](const ChunkHeader& chunk, const RecordEntry* records) {
+        stack.BeginFragment(info);
+        size_t first = 0;
+        while (first < chunk.count)
+        {
+            size_t last = first + 1;
+            while (last < chunk.count && records[last].type == records[first].type)
+            {
+                ++last;
+            }
+            ReplayRun(stack, collections, records + first, last - first);
+            first = last;
+        }
+        stack.EndFragment(info);
+    });
+    elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const auto allocated = allocations.load() - allocationsBefore;
+
+    const auto total = static_cast<double>(reader.Records());
+    printf("%-20s %12.0f points/s %9.1f ns/point %9.2f allocs/fragment\n", "replay", total / elapsed,
+           elapsed * 1e9 / total, static_cast<double>(allocated) / reader.Chunks());
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 == argc)
+        {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--points") == 0)
+        {
+            config.points = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--fragment") == 0)
+        {
+            config.fragment = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--map") == 0)
+        {
+            config.mapSize = strtoul(argv[i + 1], nullptr, 10);
+            config.syntheticMap = true;
+        }
+        else if (strcmp(argv[i], "--register-map") == 0)
+        {
+            config.registerMap = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--sink") == 0)
+        {
+            config.sink = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--replay") == 0)
+        {
+            config.replay = argv[i + 1];
+        }
+        else
+        {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (config.fragment == 0 || config.mapSize == 0 || config.mapSize > 65536)
+    {
+        fprintf(stderr, "--fragment must be positive and --map between 1 and 65536\n");
+        return 1;
+    }
+
+    if (!config.replay.empty())
+    {
+        if (config.registerMap.empty() && !config.syntheticMap)
+        {
+            fprintf(stderr, "--replay needs the --register-map the segment was recorded with, or --map N\n");
+            return 1;
+        }
+        return Replay(config);
+    }
+
+    printf("%zu points per type, %zu per fragment, %zu mapped per type, %s sink, %s conversion\n", config.points,
+           config.fragment, config.mapSize, config.sink.c_str(), ConvertKernelName());
+
+    Run<Binary>(config);
+    Run<DoubleBitBinary>(config);
+    Run<Analog>(config);
+    Run<Counter>(config);
+    Run<FrozenCounter>(config);
+    Run<BinaryOutputStatus>(config);
+    Run<AnalogOutputStatus>(config);
+
+    return 0;
+}
@@ -18,16 +18,20 @@
  * limitations under the License.
  */
 
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <thread>
+#include <vector>
 #include <stdlib.h>
+#include <unistd.h>
 #include <opendnp3/ConsoleLogger.h>
 #include <opendnp3/DNP3Manager.h>
 #include <opendnp3/channel/PrintingChannelListener.h>
 #include <opendnp3/logging/LogLevels.h>
 #include <opendnp3/master/DefaultMasterApplication.h>
-#include <opendnp3/master/PrintingCommandResultCallback.h>
 #include <opendnp3/master/PrintingSOEHandler.h>
+#include <opendnp3/master/TaskConfig.h>
 
 #include "lib/include/rapidjson/document.h"
 #include "lib/include/rapidjson/writer.h"
@@ -35,6 +39,19 @@
 #include "lib/include/rapidjson/pointer.h"
 #include "lib/include/rapidjson/plugin_api.h"
 
+#include "AdaptiveScan.h"
+#include "CommandQueue.h"
+#include "ControlPlane.h"
+#include "JsonReadingSink.h"
+#include "Metrics.h"
+#include "OutstationConfig.h"
+#include "QueuedReadingSink.h"
+#include "RecordingSink.h"
+#include "RegisterMap.h"
+#include "RegisterMapLoader.h"
+#include "ServicePool.h"
+#include "TestSOEHandler.h"
+
 using namespace std;
 using namespace opendnp3;
 using namespace rapidjson;
@@ -47,7 +64,9 @@ using namespace rapidjson;
 				    "assetName"     : "Booth1",	        \
 				    "register"      : 102,		        \
 				    "scale"         : 0.1,	            \
-				    "offset"        : 0.0	        	\
+				    "offset"        : 0.0,	        	\
+				    "deadband"      : 0.5,	        	\
+				    "maxInterval"   : 300	        	\
 			    },					                    \
 			    { 					                    \
 				    "name"          : "humidity",	    \
@@ -58,327 +77,582 @@ using namespace rapidjson;
 			  ]					                        \
 		})
 
-class TestSOEHandler : public ISOEHandler
-{
-    public: 
-        TestSOEHandler() {
-            string def_cfg = QUOTE({
-                "plugin" : {
-                    "description" : "Modbus TCP and RTU C south plugin",
-                    "type" : "string",
-                    "default" : "ModbusC",
-                    "readonly": "true"
-                    },
-                "asset" : {
-                    "description" : "Default asset name",
-                    "type" : "string",
-                    "default" : "modbus", 
-                    "order": "1",
-                    "displayName": "Asset Name",
-                    "mandatory": "true"
-                    }, 
-                "protocol" : {
-                    "description" : "Protocol",
-                    "type" : "enumeration",
-                    "default" : "RTU", 
-                    "options" : [ "RTU", "TCP"], 
-                    "order": "2",
-                    "displayName": "Protocol"
-                    }, 
-                "address" : {
-                    "description" : "Address of Modbus TCP server", 
-                    "type" : "string",
-                    "default" : "127.0.0.1", 
-                    "order": "3",
-                    "displayName": "Server Address",
-                    "validity": "protocol == \"TCP\""
-                    },
-                "port" : {
-                    "description" : "Port of Modbus TCP server", 
-                    "type" : "integer",
-                    "default" : "2222", 
-                    "order": "4",
-                    "displayName": "Port",
-                    "validity" : "protocol == \"TCP\""
-                    },
-                "device" : {
-                    "description" : "Device for Modbus RTU",
-                    "type" : "string",
-                    "default" : "",
-                    "order": "5",
-                    "displayName": "Device",
-                    "validity" : "protocol == \"RTU\""
-                    },
-                "baud" : {
-                    "description" : "Baud rate  of Modbus RTU",
-                    "type" : "integer",
-                    "default" : "9600",
-                    "order": "6",
-                    "displayName": "Baud Rate",
-                    "validity" : "protocol == \"RTU\""
-                    },
-                "bits" : {
-                    "description" : "Number of data bits for Modbus RTU",
-                    "type" : "integer",
-                    "default" : "8",
-                    "order": "7",
-                    "displayName": "Number Of Data Bits",
-                    "validity" : "protocol == \"RTU\""
-                    },
-                "stopbits" : {
-                    "description" : "Number of stop bits for Modbus RTU",
-                    "type" : "integer",
-                    "default" : "1",
-                    "order": "8",
-                    "displayName": "Number Of Stop Bits",
-                    "validity" : "protocol == \"RTU\""
-                    },
-                "parity" : {
-                    "description" : "Parity to use",
-                    "type" : "enumeration",
-                    "default" : "none",
-                    "options" : [ "none", "odd", "even" ],
-                    "order": "9",
-                    "displayName": "Parity",
-                    "validity" : "protocol == \"RTU\""
-                    },
-                "slave" : {
-                    "description" : "The Modbus device default slave ID",
-                    "type" : "integer",
-                    "default" : "1",
-                    "order": "10",
-                    "displayName": "Slave ID"
-                    },
-                "map" : {
-                    "description" : "Modbus register map",
-                    "order": "11",
-                    "displayName": "Register Map", 
-                    "type" : "JSON",
-                    "default" : DNP3_MAP
-                    },
-                "timeout" : {
-                    "description" : "Modbus request timeout",
-                    "type" : "float",
-                    "default" : "0.5",
-                    "order": "12",
-                    "displayName": "Timeout",
-                    "validity" : "protocol == \"TCP\""
-                    },
-                "control" : {
-                    "description" : "Modbus request timeout",
-                    "type" : "enumeration",
-                    "default" : "None",
-                    "order": "13",
-                    "options" : [ "None", "Use Register Map", "Use Control Map" ],
-                    "displayName": "Control"
-                    }
-                });
-
-            std::unordered_map<std::string, int> readings_name_and_register;
-            Document document;
+#define DNP3_OUTSTATIONS	QUOTE({				            \
+		"values" : [					                \
+			    {					                    \
+				    "id"            : 1,		        \
+				    "address"       : "127.0.0.1",	    \
+				    "port"          : 20000,	        \
+				    "localAddr"     : 1,		        \
+				    "remoteAddr"    : 10		        \
+			    }					                    \
+			  ]					                        \
+		})
 
-            if (document.Parse(def_cfg.c_str()).HasParseError()){
-                cout << "Parse Error" << endl;
-                //return 1;
-            }
+static const string def_cfg = QUOTE({
+    "plugin" : {
+        "description" : "Modbus TCP and RTU C south plugin",
+        "type" : "string",
+        "default" : "ModbusC",
+        "readonly": "true"
+        },
+    "asset" : {
+        "description" : "Default asset name",
+        "type" : "string",
+        "default" : "modbus", 
+        "order": "1",
+        "displayName": "Asset Name",
+        "mandatory": "true"
+        }, 
+    "protocol" : {
+        "description" : "Protocol",
+        "type" : "enumeration",
+        "default" : "RTU", 
+        "options" : [ "RTU", "TCP"], 
+        "order": "2",
+        "displayName": "Protocol"
+        }, 
+    "address" : {
+        "description" : "Address of Modbus TCP server", 
+        "type" : "string",
+        "default" : "127.0.0.1", 
+        "order": "3",
+        "displayName": "Server Address",
+        "validity": "protocol == \"TCP\""
+        },
+    "port" : {
+        "description" : "Port of Modbus TCP server", 
+        "type" : "integer",
+        "default" : "2222", 
+        "order": "4",
+        "displayName": "Port",
+        "validity" : "protocol == \"TCP\""
+        },
+    "device" : {
+        "description" : "Device for Modbus RTU",
+        "type" : "string",
+        "default" : "",
+        "order": "5",
+        "displayName": "Device",
+        "validity" : "protocol == \"RTU\""
+        },
+    "baud" : {
+        "description" : "Baud rate  of Modbus RTU",
+        "type" : "integer",
+        "default" : "9600",
+        "order": "6",
+        "displayName": "Baud Rate",
+        "validity" : "protocol == \"RTU\""
+        },
+    "bits" : {
+        "description" : "Number of data bits for Modbus RTU",
+        "type" : "integer",
+        "default" : "8",
+        "order": "7",
+        "displayName": "Number Of Data Bits",
+        "validity" : "protocol == \"RTU\""
+        },
+    "stopbits" : {
+        "description" : "Number of stop bits for Modbus RTU",
+        "type" : "integer",
+        "default" : "1",
+        "order": "8",
+        "displayName": "Number Of Stop Bits",
+        "validity" : "protocol == \"RTU\""
+        },
+    "parity" : {
+        "description" : "Parity to use",
+        "type" : "enumeration",
+        "default" : "none",
+        "options" : [ "none", "odd", "even" ],
+        "order": "9",
+        "displayName": "Parity",
+        "validity" : "protocol == \"RTU\""
+        },
+    "slave" : {
+        "description" : "The Modbus device default slave ID",
+        "type" : "integer",
+        "default" : "1",
+        "order": "10",
+        "displayName": "Slave ID"
+        },
+    "map" : {
+        "description" : "Modbus register map",
+        "order": "11",
+        "displayName": "Register Map", 
+        "type" : "JSON",
+        "default" : DNP3_MAP
+        },
+    "timeout" : {
+        "description" : "Modbus request timeout",
+        "type" : "float",
+        "default" : "0.5",
+        "order": "12",
+        "displayName": "Timeout",
+        "validity" : "protocol == \"TCP\""
+        },
+    "control" : {
+        "description" : "Modbus request timeout",
+        "type" : "enumeration",
+        "default" : "None",
+        "order": "13",
+        "options" : [ "None", "Use Register Map", "Use Control Map" ],
+        "displayName": "Control"
+        },
+    "outstations" : {
+        "description" : "Outstations to poll, one channel and master each",
+        "order": "14",
+        "displayName": "Outstations",
+        "type" : "JSON",
+        "default" : DNP3_OUTSTATIONS
+        },
+    "record" : {
+        "description" : "Directory to record readings to in binary segments, empty to disable",
+        "type" : "string",
+        "default" : "",
+        "order": "15",
+        "displayName": "Recording Directory"
+        }
+    });
 
-            auto map = document["map"].GetObject();
-            assert(map.HasMember("default"));
+/**
+ * Everything started for one outstation. Nothing in here is shared with another poller.
+ */
+struct Poller
+{
+    OutstationConfig config;
+    std::shared_ptr<IChannel> channel;
+    std::shared_ptr<IMaster> master;
+    std::shared_ptr<QueuedReadingSink> sink;
+    std::shared_ptr<RecordingSink> recorder;
+    std::shared_ptr<TestSOEHandler> handler;
+    std::shared_ptr<IMasterScan> integrityScan;
+    std::shared_ptr<IMasterScan> exceptionScan;
+    std::shared_ptr<AdaptiveScan> adaptiveScan;
+    std::shared_ptr<CommandQueue> commands;
+    std::shared_ptr<MasterMetrics> metrics;
+};
 
-            auto default_string = map["default"].GetString();
-            cout << default_string  << endl;
-            Document d2;
-            if(d2.Parse(default_string).HasParseError()){
-                cout << "Parse error in default" << endl;
-                //return 2;
-            }
+/// @return argument n if it was given and is not empty, otherwise the item's configured value or its default
+static string Setting(const Value& item, int argc, char* argv[], int n)
+{
+    if (argc > n && argv[n][0] != '\0')
+    {
+        return argv[n];
+    }
+    return item.HasMember("value") ? item["value"].GetString() : item["default"].GetString();
+}
 
-            auto values = d2["values"].GetArray();
-            
-            // cycle through values and build hasmap of reading name and register
-            for (auto& m : values){
-                auto reading_name = m["name"].GetString();
-                auto register_num = m["register"].GetInt();
-                readings_name_and_register[reading_name] = register_num;
-            }
+/// Merge the histograms of every master into one report
+static MetricsReport CollectMetrics(const std::vector<Poller>& pollers)
+{
+    MetricsReport report;
+    for (const auto& poller : pollers)
+    {
+        const auto& metrics = *poller.metrics;
+        report.Add("fragment_ns", metrics.fragmentNs);
+        report.Add("points_per_fragment", metrics.pointsPerFragment);
+        for (size_t i = 0; i < POINT_TYPE_COUNT; ++i)
+        {
+            report.Add(string("process_ns.") + PointTypeName(static_cast<PointType>(i)), metrics.processNs[i]);
+        }
+        report.Add("device_lag_ms", metrics.deviceLagMs);
+        report.Add("integrity_scan_ms", metrics.integrityScanMs);
+        report.Add("event_scan_ms", metrics.eventScanMs);
+        report.Add("command_ms", metrics.commandMs);
+        report.Add("delivery_us", poller.sink->DeliveryMicros());
+    }
+    return report;
+}
 
-            for (auto& tup : readings_name_and_register)
-            {
-                cout << tup.first << " : " << tup.second << endl;
-            }
+/// Print the outcome of one queued command
+static void PrintCommandResult(const string& name, const CommandResult& result)
+{
+    std::cout << name << " command " << result.index << ": " << TaskCompletionSpec::to_string(result.summary) << ", "
+              << CommandPointStateSpec::to_string(result.state) << ", " << CommandStatusSpec::to_string(result.status)
+              << " in " << result.latency.count() << " us, " << result.batchSize << " in request" << std::endl;
+}
 
-            auto value1 = d2["values"][0].GetObj();
-            auto name = value1["name"].GetString();
-                    cout << "SOE Handler Created" << endl;
+/// Reading queue, polling, command and recording statistics, a few lines per master
+static void PrintStatistics(const std::vector<Poller>& pollers, std::ostream& output)
+{
+    for (const auto& poller : pollers)
+    {
+        const auto& queue = poller.sink->Queue();
+        output << poller.config.Name() << " reading queue capacity: " << queue.Capacity()
+               << ", high water: " << queue.HighWater() << ", dropped: " << queue.Dropped()
+               << ", suppressed by deadband: " << poller.handler->Filter().Suppressed()
+               << ", map reloads: " << poller.handler->Reloads() << std::endl;
+        output << poller.config.Name() << " class 1 poll interval: " << poller.adaptiveScan->Interval().count()
+               << " ms, last poll took: " << poller.adaptiveScan->LastLatency().count() << " ms" << std::endl;
+        output << poller.config.Name() << " commands: " << poller.commands->Submitted() << " in "
+               << poller.commands->Requests() << " requests, " << poller.commands->Pending() << " queued" << std::endl;
+        if (poller.recorder)
+        {
+            output << poller.config.Name() << " recorded: " << poller.recorder->Records() << " readings, "
+                   << poller.recorder->Bytes() << " bytes, segment " << poller.recorder->Sequence()
+                   << (poller.recorder->Recording() ? "" : ", stopped") << std::endl;
         }
-    private: 
-
-        virtual void BeginFragment(const ResponseInfo& info){};
-        virtual void EndFragment(const ResponseInfo& info){};
-
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<Binary>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<DoubleBitBinary>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<Analog>>& values) {
-            auto print = [](const Indexed<Analog>& pair) {
-                double v = pair.value.value;
-                //std::cout << "[" << pair.index << "] : " << to_string(pair.value.value) << std::endl;
-                if (pair.index == 3) {
-                    cout << "[" << pair.index << "] : " << to_string(pair.value.value) << std::endl;
-                }
-                else {
-                    std::cout << "[" << pair.index << "] : " << "Not printed" << std::endl; 
-                }
-            };
-
-            
-            values.ForeachItem(print); 
-            //cout << "Values at position 3 " << pair.value.value << endl;
-            cout << "Count : " << values.Count() << endl;
-
-            
-            //Indexed<Analog>& new_index = [];
-            //Indexed<Analog>& new_val = values.ReadOnlyValue();
-            //cout << "Value [3] = " << values.value[0].value[3] << endl;
-            
-        };
-        
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<Counter>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<FrozenCounter>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<BinaryOutputStatus>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<AnalogOutputStatus>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<OctetString>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<TimeAndInterval>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<BinaryCommandEvent>>& values) {};
-        virtual void Process(const HeaderInfo& info, const ICollection<Indexed<AnalogCommandEvent>>& values) {};    
-        virtual void Process(const HeaderInfo& info, const ICollection<DNPTime>& values) {};
-};
+    }
+}
+
+/**
+ * Load the map again and publish each master's new table, polling carries on throughout
+ *
+ * @return false if the map could not be read and the current one stays in use
+ */
+static bool ReloadMaps(const string& source,
+                       const string& defaultAsset,
+                       const std::vector<uint16_t>& outstationIds,
+                       const std::shared_ptr<StringPool>& strings,
+                       std::vector<Poller>& pollers,
+                       std::ostream& output)
+{
+    string errors;
+    MapLoadStats stats;
+    auto maps = RegisterMapLoader::Load(source, defaultAsset, outstationIds, errors, &stats, strings);
+    output << errors;
+    if (maps.empty())
+    {
+        output << "Register map not reloaded, the current one stays in use" << endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < pollers.size(); ++i)
+    {
+        pollers[i].handler->Reload(std::make_shared<const RegisterMap>(std::move(maps[i])));
+    }
+    output << "Register map reloaded: " << stats.entries << " entries, " << stats.rejected << " rejected, loaded in "
+         << stats.elapsed.count() << " us" << endl;
+    return true;
+}
 
 int main(int argc, char* argv[])
 {
+    Document document;
+    if (document.Parse(def_cfg.c_str()).HasParseError()){
+        cout << "Parse Error" << endl;
+        return 1;
+    }
+
+    // the outstation list is loaded like the map, from the command line, the configured value or the default
+    const string outstationSource = Setting(document["outstations"], argc, argv, 4);
+
+    string errors;
+    const auto outstations = OutstationConfig::Load(outstationSource, errors);
+    if (!errors.empty())
+    {
+        cout << errors;
+    }
+    if (outstations.empty())
+    {
+        cout << "No outstations configured" << endl;
+        return 1;
+    }
+
+    // the map is inline JSON or a file path, from the command line, the configured value or the default
+    string mapSource = Setting(document["map"], argc, argv, 1);
+
+    std::vector<uint16_t> outstationIds;
+    for (const auto& outstation : outstations)
+    {
+        outstationIds.push_back(outstation.id);
+    }
+
+    // compile every outstation's table in one pass over the map, reloads intern into the same strings
+    const string defaultAsset = document["asset"]["default"].GetString();
+    const auto mapStrings = std::make_shared<StringPool>();
+    string mapErrors;
+    MapLoadStats mapStats;
+    auto registerMaps = RegisterMapLoader::Load(mapSource, defaultAsset, outstationIds, mapErrors, &mapStats, mapStrings);
+    cout << mapErrors;
+    if (registerMaps.empty())
+    {
+        cout << "Register map could not be loaded" << endl;
+        return 1;
+    }
+    cout << "Register map: " << mapStats.entries << " entries, " << mapStats.rejected << " rejected, loaded in "
+         << mapStats.elapsed.count() << " us" << endl;
+
     // Specify what log levels to use. NORMAL is warning and above
     // You can add all the comms logging by uncommenting below
     const auto logLevels = levels::NORMAL | levels::ALL_APP_COMMS;
 
-    // This is the main point of interaction with the stack
-    DNP3Manager manager(1, ConsoleLogger::Create());
+    // This is the main point of interaction with the stack. Each channel is
+    // serviced by one thread at a time, so more threads than channels or cores
+    // would only sit idle.
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
 
-    // Connect via a TCPClient socket to a outstation
-    auto channel = manager.AddTCPClient("tcpclient", logLevels, ChannelRetry::Default(), {IPEndpoint("127.0.0.1", 20000)},
-                                        "0.0.0.0", PrintingChannelListener::Create());
+    // the queue consumers of all masters share a few threads, declared before the manager like
+    // the pools below so they outlive anything the stack still calls into while it shuts down
+    ServicePool consumers(std::min<size_t>(outstations.size(), cores));
 
-    // The master config object for a master. The default are
-    // useable, but understanding the options are important.
-    MasterStackConfig stackConfig;
+    // sending a batch only hands it to the stack, so one thread serves every command queue and
+    // a consumer blocked on a slow output never holds up a command
+    ServicePool senders(1);
 
-    // you can override application layer settings for the master here
-    // in this example, we've change the application layer timeout to 2 seconds
-    stackConfig.master.responseTimeout = TimeDuration::Seconds(2);
-    stackConfig.master.disableUnsolOnStartup = true;
+    // a disk sync can block for a while, so recordings are synced and rotated on a thread of
+    // their own rather than holding up the queue consumers
+    ServicePool syncers(1);
+    DNP3Manager manager(std::min<size_t>(outstations.size(), cores), ConsoleLogger::Create());
 
-    // You can override the default link layer settings here
-    // in this example we've changed the default link layer addressing
-    stackConfig.link.LocalAddr = 1;
-    stackConfig.link.RemoteAddr = 10;
+    // formatting and output run on a service thread, off the stack's threads
+    QueueConfig queueConfig;
+    queueConfig.capacity = 16384;
+    queueConfig.policy = OverflowPolicy::DropOldest;
 
-    // Create a new master on a previously declared port, with a
-    // name, log level, command acceptor, and config info. This
-    // returns a thread-safe interface used for sending commands.
-    auto master = channel->AddMaster("master",                           // id for logging
-                                     PrintingSOEHandler::Create(),       // callback for data processing
-                                     DefaultMasterApplication::Create(), // master application instance
-                                     stackConfig                         // stack configuration
-    );
+    // readings are written on the stack's thread, one chunk per fragment, before they are queued
+    RecordingConfig recordConfig;
+    recordConfig.directory = Setting(document["record"], argc, argv, 2);
 
-    auto test_soe_handler = std::make_shared<TestSOEHandler>();
+    // the Class 1 scan speeds up while events arrive and backs off on idle or slow links
+    AdaptivePollConfig pollConfig;
+    PollScheduler scheduler;
 
-    // do an integrity poll (Class 3/2/1/0) once per minute
-    auto integrityScan = master->AddClassScan(ClassField::AllClasses(), TimeDuration::Minutes(1), test_soe_handler);
+    // commands issued within 20 ms of each other share one select/operate exchange
+    CommandQueueConfig commandConfig;
 
-    // do a Class 1 exception poll every 5 seconds
-    auto exceptionScan = master->AddClassScan(ClassField(ClassField::CLASS_1), TimeDuration::Seconds(2), test_soe_handler);
+    std::vector<Poller> pollers;
+    pollers.reserve(outstations.size());
 
-    // Enable the master. This will start communications.
-    master->Enable();
+    for (size_t i = 0; i < outstations.size(); ++i)
+    {
+        const auto& outstation = outstations[i];
+
+        Poller poller;
+        poller.config = outstation;
+
+        // Connect via a TCPClient socket to a outstation
+        poller.channel = manager.AddTCPClient(outstation.Name(), logLevels, ChannelRetry::Default(),
+                                              {IPEndpoint(outstation.host, outstation.port)}, "0.0.0.0",
+                                              PrintingChannelListener::Create());
+
+        // The master config object for a master. The default are
+        // useable, but understanding the options are important.
+        MasterStackConfig stackConfig;
+
+        // you can override application layer settings for the master here
+        // in this example, we've change the application layer timeout to 2 seconds
+        stackConfig.master.responseTimeout = TimeDuration::Seconds(2);
+        stackConfig.master.disableUnsolOnStartup = true;
+
+        // link layer addressing comes from the outstation list
+        stackConfig.link.LocalAddr = outstation.localAddr;
+        stackConfig.link.RemoteAddr = outstation.remoteAddr;
+
+        // Create a new master on a previously declared port, with a
+        // name, log level, command acceptor, and config info. This
+        // returns a thread-safe interface used for sending commands.
+        poller.master = poller.channel->AddMaster(outstation.Name(),                  // id for logging
+                                                  PrintingSOEHandler::Create(),       // callback for data processing
+                                                  DefaultMasterApplication::Create(), // master application instance
+                                                  stackConfig                         // stack configuration
+        );
+
+        auto& registers = registerMaps[i];
+        cout << outstation.Name() << ": SOE Handler Created, " << registers.Count() << " points mapped" << endl;
+
+        poller.metrics = std::make_shared<MasterMetrics>();
+        poller.sink
+            = std::make_shared<QueuedReadingSink>(std::make_shared<JsonReadingSink>(stdout), queueConfig, consumers.Assign());
+        std::shared_ptr<IReadingSink> sink = poller.sink;
+        if (!recordConfig.directory.empty())
+        {
+            string recordErrors;
+            poller.recorder = RecordingSink::Open(poller.sink, outstation.id, recordConfig, syncers.Assign(), recordErrors);
+            if (!poller.recorder)
+            {
+                cout << recordErrors;
+                return 1;
+            }
+            sink = poller.recorder;
+        }
+        poller.handler = std::make_shared<TestSOEHandler>(std::make_shared<const RegisterMap>(std::move(registers)), sink,
+                                                          poller.metrics);
+
+        // the scan callbacks share ownership of the metrics they record into
+        const std::shared_ptr<Histogram> integrityDurations(poller.metrics, &poller.metrics->integrityScanMs);
+        const std::shared_ptr<Histogram> eventDurations(poller.metrics, &poller.metrics->eventScanMs);
+
+        // do an integrity poll (Class 3/2/1/0) once per minute
+        poller.integrityScan = poller.master->AddClassScan(ClassField::AllClasses(), TimeDuration::Minutes(1), poller.handler,
+                                                           TaskConfig::With(std::make_shared<ScanTimer>(integrityDurations)));
+
+        // do a Class 1 exception poll at least every maxInterval, demanded sooner by the scheduler
+        auto handler = poller.handler;
+        poller.adaptiveScan = std::make_shared<AdaptiveScan>(
+            pollConfig, [handler]() { return handler->PointsReceived(); }, eventDurations);
+        poller.exceptionScan = poller.master->AddClassScan(ClassField(ClassField::CLASS_1),
+                                                           TimeDuration::Milliseconds(pollConfig.maxInterval.count()),
+                                                           poller.handler, TaskConfig::With(poller.adaptiveScan));
+        poller.adaptiveScan->Attach(poller.exceptionScan);
+        scheduler.Add(poller.adaptiveScan);
+
+        const std::shared_ptr<Histogram> commandLatencies(poller.metrics, &poller.metrics->commandMs);
+        poller.commands = std::make_shared<CommandQueue>(poller.master, commandConfig, senders.Assign(), commandLatencies);
+
+        pollers.push_back(std::move(poller));
+    }
+
+    // Enable the masters. This will start communications.
+    for (auto& poller : pollers)
+    {
+        poller.master->Enable();
+    }
+
+    scheduler.Start();
+
+    // latency percentiles as one JSON line on stderr, away from the readings on stdout
+    MetricsDumper dumper(std::chrono::seconds(60), [&pollers]() { return CollectMetrics(pollers).ToJson(); }, stderr);
 
     bool channelCommsLoggingEnabled = true;
     bool masterCommsLoggingEnabled = true;
 
-
-    while (true)
-    {
-        std::cout << "Enter a command" << std::endl;
-        std::cout << "x - exits program" << std::endl;
-        std::cout << "a - performs an ad-hoc range scan" << std::endl;
-        std::cout << "i - integrity demand scan" << std::endl;
-        std::cout << "e - exception demand scan" << std::endl;
-        std::cout << "d - disable unsolicited" << std::endl;
-        std::cout << "r - cold restart" << std::endl;
-        std::cout << "c - send crob" << std::endl;
-        std::cout << "t - toggle channel logging" << std::endl;
-        std::cout << "u - toggle master logging" << std::endl;
-
-        char cmd;
-        std::cin >> cmd;
-        switch (cmd)
+    // commands from stdin and the optional control socket, none of them block the main thread
+    ControlPlane control;
+    using Args = std::vector<std::string>;
+
+    control.Add("x|quit", "exits program", [&control](const Args&, std::ostream&) {
+        // C++ destructor on DNP3Manager cleans everything up for you
+        control.Stop();
+        return true;
+    });
+    control.Add("a", "performs an ad-hoc range scan", [&pollers](const Args&, std::ostream&) {
+        for (auto& poller : pollers)
+        {
+            poller.master->ScanRange(GroupVariationID(1, 2), 0, 3, poller.handler);
+        }
+        return true;
+    });
+    control.Add("i", "integrity demand scan", [&pollers](const Args&, std::ostream&) {
+        for (auto& poller : pollers)
+        {
+            poller.integrityScan->Demand();
+        }
+        return true;
+    });
+    control.Add("e", "exception demand scan", [&pollers](const Args&, std::ostream&) {
+        for (auto& poller : pollers)
+        {
+            poller.exceptionScan->Demand();
+        }
+        return true;
+    });
+    control.Add("d", "disable unsolicited", [&pollers](const Args&, std::ostream&) {
+        for (auto& poller : pollers)
+        {
+            poller.master->PerformFunction("disable unsol", FunctionCode::DISABLE_UNSOLICITED,
+                                           {Header::AllObjects(60, 2), Header::AllObjects(60, 3), Header::AllObjects(60, 4)});
+        }
+        return true;
+    });
+    control.Add("r", "cold restart", [&pollers](const Args&, std::ostream&) {
+        // results arrive later on the stack thread, so they go to stdout
+        auto print = [](const RestartOperationResult& result) {
+            if (result.summary == TaskCompletion::SUCCESS)
+            {
+                std::cout << "Success, Time: " << result.restartTime.ToString() << std::endl;
+            }
+            else
+            {
+                std::cout << "Failure: " << TaskCompletionSpec::to_string(result.summary) << std::endl;
+            }
+        };
+        for (auto& poller : pollers)
         {
-        case ('a'):
-            master->ScanRange(GroupVariationID(1, 2), 0, 3, test_soe_handler);
-            break;
-        case ('d'):
-            master->PerformFunction("disable unsol", FunctionCode::DISABLE_UNSOLICITED,
-                                    {Header::AllObjects(60, 2), Header::AllObjects(60, 3), Header::AllObjects(60, 4)});
-            break;
-        case ('r'):
+            poller.master->Restart(RestartType::COLD, print);
+        }
+        return true;
+    });
+    control.Add("c", "send crob", [&pollers](const Args&, std::ostream&) {
+        ControlRelayOutputBlock crob(OperationType::LATCH_ON);
+        for (auto& poller : pollers)
         {
-            auto print = [](const RestartOperationResult& result) {
-                if (result.summary == TaskCompletion::SUCCESS)
-                {
-                    std::cout << "Success, Time: " << result.restartTime.ToString() << std::endl;
-                }
-                else
-                {
-                    std::cout << "Failure: " << TaskCompletionSpec::to_string(result.summary) << std::endl;
-                }
-            };
-            master->Restart(RestartType::COLD, print);
-            break;
+            const auto name = poller.config.Name();
+            poller.commands->Submit(crob, 0, [name](const CommandResult& result) { PrintCommandResult(name, result); });
         }
-        case ('x'):
-            // C++ destructor on DNP3Manager cleans everything up for you
-            return 0;
-        case ('i'):
-            integrityScan->Demand();
-            break;
-        case ('e'):
-            exceptionScan->Demand();
-            break;
-        case ('c'):
+        return true;
+    });
+    control.Add("b", "send a burst of crobs to points 0 to 9", [&pollers](const Args&, std::ostream&) {
+        // queued together, so each master sends them as one request
+        ControlRelayOutputBlock crob(OperationType::LATCH_ON);
+        for (auto& poller : pollers)
         {
-            ControlRelayOutputBlock crob(OperationType::LATCH_ON);
-            master->SelectAndOperate(crob, 0, PrintingCommandResultCallback::Get());
-            break;
+            const auto name = poller.config.Name();
+            for (uint16_t index = 0; index < 10; ++index)
+            {
+                poller.commands->Submit(crob, index, [name](const CommandResult& result) { PrintCommandResult(name, result); });
+            }
         }
-        case ('t'):
+        return true;
+    });
+    control.Add("t", "toggle channel logging", [&](const Args&, std::ostream& output) {
+        channelCommsLoggingEnabled = !channelCommsLoggingEnabled;
+        auto levels = channelCommsLoggingEnabled ? levels::ALL_COMMS : levels::NORMAL;
+        for (auto& poller : pollers)
         {
-            channelCommsLoggingEnabled = !channelCommsLoggingEnabled;
-            auto levels = channelCommsLoggingEnabled ? levels::ALL_COMMS : levels::NORMAL;
-            channel->SetLogFilters(levels);
-            std::cout << "Channel logging set to: " << levels.get_value() << std::endl;
-            break;
+            poller.channel->SetLogFilters(levels);
         }
-        case ('u'):
+        output << "Channel logging set to: " << levels.get_value() << std::endl;
+        return true;
+    });
+    control.Add("u", "toggle master logging", [&](const Args&, std::ostream& output) {
+        masterCommsLoggingEnabled = !masterCommsLoggingEnabled;
+        auto levels = masterCommsLoggingEnabled ? levels::ALL_COMMS : levels::NORMAL;
+        for (auto& poller : pollers)
         {
-            masterCommsLoggingEnabled = !masterCommsLoggingEnabled;
-            auto levels = masterCommsLoggingEnabled ? levels::ALL_COMMS : levels::NORMAL;
-            master->SetLogFilters(levels);
-            std::cout << "Master logging set to: " << levels.get_value() << std::endl;
-            break;
+            poller.master->SetLogFilters(levels);
         }
-        default:
-            std::cout << "Unknown action: " << cmd << std::endl;
-            break;
+        output << "Master logging set to: " << levels.get_value() << std::endl;
+        return true;
+    });
+    control.Add("q", "print reading queue, polling, command and recording statistics",
+                [&pollers](const Args&, std::ostream& output) {
+                    PrintStatistics(pollers, output);
+                    return true;
+                });
+    control.Add("m", "print latency histograms",
+                [&pollers](const Args&, std::ostream& output) {
+                    CollectMetrics(pollers).Print(output);
+                    return true;
+                });
+    control.Add("stats", "print statistics and histograms, or the histograms as one JSON line with 'stats json'",
+                [&pollers](const Args& args, std::ostream& output) {
+                    if (!args.empty() && args[0] == "json")
+                    {
+                        output << CollectMetrics(pollers).ToJson() << std::endl;
+                        return true;
+                    }
+                    PrintStatistics(pollers, output);
+                    CollectMetrics(pollers).Print(output);
+                    return true;
+                });
+    control.AddRaw("l|reload", "reload the register map, or load it from the file or JSON given after the command",
+                   [&](const Args& args, std::ostream& output) {
+                       // a new source is only kept once it has loaded, so a bad one does not break the next reload
+                       const auto source = args.empty() ? mapSource : args[0];
+                       if (!ReloadMaps(source, defaultAsset, outstationIds, mapStrings, pollers, output))
+                       {
+                           return false;
+                       }
+                       mapSource = source;
+                       return true;
+                   });
+
+    control.WatchInput(STDIN_FILENO);
+    if (argc > 3 && argv[3][0] != '\0')
+    {
+        string controlErrors;
+        if (!control.Listen(argv[3], controlErrors))
+        {
+            cout << controlErrors;
+            return 1;
         }
+        cout << "Accepting commands on " << argv[3] << endl;
     }
 
+    control.PrintHelp(std::cout);
+    control.Run();
+
     return 0;
 }